@@ -79,6 +79,10 @@ static struct list queue = { 0, 0 };
 
 static struct mutex ata_mutex = MUTEX_INIT;
 
+// Geometry of each unit, as found by ata_init
+static int ata_nblocks[4] = { 0, 0, 0, 0 };
+static int ata_blocksize[4] = { 0, 0, 0, 0 };
+
 static void ata_interrupt(int intr, int code) {
     ata_interrupt_active = 1;
     process_wakeup_all(&queue);
@@ -339,6 +343,30 @@ int ata_write(int id, void *buffer, int nblocks, int offset) {
     return result;
 }
 
+/*
+ata_write_vector writes several buffers to consecutive blocks under a
+single acquisition of the lock, so no other transfer gets in between.
+*/
+
+int ata_write_vector(int id, void **buffers, int nbuffers, int blocks_per_buffer,
+                     int offset) {
+    int i;
+    if (nbuffers <= 0 || blocks_per_buffer <= 0 ||
+        blocks_per_buffer > ATA_MAX_BLOCKS_PER_COMMAND) {
+        return 0;
+    }
+    mutex_lock(&ata_mutex);
+    for (i = 0; i < nbuffers; i++) {
+        if (!ata_write_unlocked(id, buffers[i], blocks_per_buffer, offset)) {
+            mutex_unlock(&ata_mutex);
+            return 0;
+        }
+        offset += blocks_per_buffer;
+    }
+    mutex_unlock(&ata_mutex);
+    return nbuffers * blocks_per_buffer;
+}
+
 /*
 ata_probe sends an IDENTIFY DEVICE command to the device.
 If a device is connected, it will respond with 512 bytes
@@ -431,6 +459,18 @@ void ata_init() {
     console_printf("ata: probing devices\n");
 
     for (i = 0; i < 4; i++) {
-        ata_probe(i, &nblocks, &blocksize, longname);
+        if (ata_probe(i, &nblocks, &blocksize, longname)) {
+            ata_nblocks[i] = nblocks;
+            ata_blocksize[i] = blocksize;
+        }
     }
 }
+
+int ata_geometry(int id, int *nblocks, int *blocksize) {
+    if (id < 0 || id >= 4 || !ata_nblocks[id]) {
+        return 0;
+    }
+    *nblocks = ata_nblocks[id];
+    *blocksize = ata_blocksize[id];
+    return 1;
+}
@@ -10,13 +10,19 @@ See the file LICENSE for details.
 #define ATA_BLOCKSIZE 512
 #define ATAPI_BLOCKSIZE 2048
 
+// The sector count register is 8 bits wide, and 0 means 256
+#define ATA_MAX_BLOCKS_PER_COMMAND 255
+
 void ata_init();
 
 void ata_reset(int unit);
 int ata_probe(int unit, int *nblocks, int *blocksize, char *name);
+int ata_geometry(int unit, int *nblocks, int *blocksize);
 
 int ata_read(int unit, void *buffer, int nblocks, int offset);
 int ata_write(int unit, void *buffer, int nblocks, int offset);
+int ata_write_vector(int unit, void **buffers, int nbuffers,
+                     int blocks_per_buffer, int offset);
 int atapi_read(int unit, void *buffer, int nblocks, int offset);
 
 #endif
@@ -9,17 +9,6 @@ int _start() {
 #define CHAR_SIZE 8
 
 #define DRAW_OFFSET 10
-clock_t clock_diff(clock_t start, clock_t stop) {
-    clock_t result;
-    if (stop.millis < start.millis) {
-        stop.millis += 1000;
-        stop.seconds -= 1;
-    }
-    result.seconds = stop.seconds - start.seconds;
-    result.millis = stop.millis - start.millis;
-    return result;
-}
-
 int main() {
     int curr_char = DRAW_OFFSET;
     struct rtc_time t;
@@ -28,7 +17,7 @@ int main() {
     create_window(250, 250, 100, 30);
     while (1) {
         sleep(1000);
-        read_rtc(&t);
+        read_wall_clock(&t);
         clear();
         if (t.hour > 9) {
             draw_char(0 + DRAW_OFFSET, curr_char, (t.hour / 10) + '0', &fgc, &bgc);
@@ -0,0 +1,42 @@
+int main();
+int _start() {
+    return main();
+}
+
+#include "syscall.h"
+
+/*
+Context switch benchmark: run two copies at once (the switch_bench
+command does), and they yield to each other. Each copy prints the
+switches per second it saw, then the nanoseconds per switch.
+*/
+
+#define ROUNDS 100000
+
+int main() {
+    uint64_t start, elapsed;
+    uint32_t ns_per_switch, rem;
+    int i;
+
+    // Give the other copy time to start
+    sleep(200);
+
+    start = read_clock_ns();
+    for (i = 0; i < ROUNDS; i++) {
+        yield();
+    }
+    elapsed = read_clock_ns() - start;
+
+    // Both copies yield once per round, so there are two switches per round
+    asm("divl %4" : "=a"(ns_per_switch), "=d"(rem)
+        : "a"((uint32_t)elapsed), "d"((uint32_t)(elapsed >> 32)),
+          "rm"(2 * ROUNDS));
+    if (ns_per_switch == 0) {
+        ns_per_switch = 1;
+    }
+    debug_print(1000000000 / ns_per_switch);
+    debug_print(ns_per_switch);
+
+    exit(0);
+    return 0;
+}
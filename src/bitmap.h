@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include "kerneltypes.h"
+
+/*
+ * Bitmaps are arrays of 32 bit cells, with bit n of the map stored in bit
+ * n % 32 of cell n / 32.
+ */
+
+#define BITMAP_CELL_BITS 32
+#define BITMAP_CELLS(bits) (((bits) + BITMAP_CELL_BITS - 1) / BITMAP_CELL_BITS)
+
+static inline void bitmap_set(uint32_t *map, uint32_t bit) {
+    map[bit / BITMAP_CELL_BITS] |= (1 << (bit % BITMAP_CELL_BITS));
+}
+
+static inline void bitmap_clear(uint32_t *map, uint32_t bit) {
+    map[bit / BITMAP_CELL_BITS] &= ~(1 << (bit % BITMAP_CELL_BITS));
+}
+
+static inline bool bitmap_test(const uint32_t *map, uint32_t bit) {
+    return (map[bit / BITMAP_CELL_BITS] >> (bit % BITMAP_CELL_BITS)) & 1;
+}
+
+/**
+ * @brief   Find the lowest set bit of a bitmap
+ * @details Skips empty cells a whole cell at a time, and finds the bit within
+ *          the first non-empty cell with a single bsf instruction.
+ *
+ * @param   map     The bitmap to search
+ * @param   cells   The number of cells in the bitmap
+ * @return  The index of the lowest set bit, or -1 if no bit is set
+ */
+static inline int32_t bitmap_first_set(const uint32_t *map, uint32_t cells) {
+    uint32_t i;
+    for (i = 0; i < cells; i++) {
+        if (map[i]) {
+            uint32_t bit;
+            asm("bsfl %1, %0" : "=r"(bit) : "rm"(map[i]));
+            return i * BITMAP_CELL_BITS + bit;
+        }
+    }
+    return -1;
+}
+
+#endif
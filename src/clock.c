@@ -7,40 +7,198 @@ See the file LICENSE for details.
 #include "console.h"
 #include "interrupt.h"
 #include "clock.h"
-#include "ioports.h"
 #include "process.h"
+#include "pit.h"
+#include "timer.h"
+#include "cpu.h"
+#include "clock_page.h"
+#include "rtc.h"
+#include "workqueue.h"
 
-#define CLICKS_PER_SECOND 10
+static struct clockevent *clockevent = 0;
+static uint32_t tick_count = 0;     // timer counts per tick
 
-#define TIMER0      0x40
-#define TIMER_MODE  0x43
-#define SQUARE_WAVE     0x36
-#define TIMER_FREQ  1193182
-#define TIMER_COUNT (((unsigned)TIMER_FREQ)/CLICKS_PER_SECOND/2)
+// A tick that is almost over is not worth stopping, since its interrupt
+// could become pending while the timer is being reprogrammed
+#define TICK_MARGIN (tick_count / 8)
 
-static uint32_t clicks = 0;
-static uint32_t seconds = 0;
+static uint32_t clicks = 0;     // ticks since the last full second
+static uint32_t ticks = 0;
 
-static struct list queue = { 0, 0 };
+// With a TSC, the time since clock_init is base_ns plus the cycles counted
+// since base_tsc, times tsc_mult, plus base_frac, shifted right by TSC_SHIFT.
+// Every clock interrupt moves the base forward, which keeps the product from
+// overflowing, and base_frac keeps the bits shifted out so that the time
+// does not jump back when it does.
+#define TSC_SHIFT 22
+#define TSC_CALIBRATE_COUNT (PIT_FREQ / 20)
+
+static uint32_t tsc_khz = 0;    // 0 without a usable TSC
+static uint32_t tsc_mult = 0;
+static uint64_t base_tsc = 0;
+static uint64_t base_ns = 0;
+static uint32_t base_frac = 0;
+static uint64_t last_ns = 0;    // latest time returned, to stay monotonic
+
+// While the periodic tick is stopped, a one-shot stands for oneshot_ticks
+// ticks, the first of which ends oneshot_first counts after it started
+static int oneshot = 0;
+static uint32_t oneshot_ticks = 0;
+static uint32_t oneshot_first = 0;
+
+// Divide a 64 bit number by a 32 bit one, when the quotient fits 32 bits
+static uint32_t clock_div64(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t q, r;
+    asm("divl %4" : "=a"(q), "=d"(r)
+        : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+    if (rem) {
+        *rem = r;
+    }
+    return q;
+}
+
+// Count the TSC cycles of a delay timed by the PIT
+static void clock_calibrate_tsc() {
+    if (!cpu_has(CPU_FEATURE_TSC)) {
+        return;
+    }
+
+    unsigned flags = interrupt_save();
+    uint64_t start = cpu_read_tsc();
+    pit_delay(TSC_CALIBRATE_COUNT);
+    uint64_t cycles = cpu_read_tsc() - start;
+    interrupt_restore(flags);
+
+    tsc_khz = clock_div64(cycles * PIT_FREQ, TSC_CALIBRATE_COUNT * 1000, 0);
+    if (tsc_khz <= 1000) {
+        tsc_khz = 0;
+        return;
+    }
+    tsc_mult = clock_div64((uint64_t)1000000 << TSC_SHIFT, tsc_khz, 0);
+    base_tsc = cpu_read_tsc();
+}
+
+static uint64_t clock_tsc_scaled(uint64_t tsc) {
+    return (tsc - base_tsc) * tsc_mult + base_frac;
+}
+
+static uint64_t clock_tsc_ns(uint64_t tsc) {
+    return base_ns + (clock_tsc_scaled(tsc) >> TSC_SHIFT);
+}
+
+static void clock_rebase() {
+    uint64_t tsc = cpu_read_tsc();
+    uint64_t scaled = clock_tsc_scaled(tsc);
+    base_ns += scaled >> TSC_SHIFT;
+    base_frac = scaled & ((1 << TSC_SHIFT) - 1);
+    base_tsc = tsc;
+}
+
+// Publish the tick count and time base to user processes
+static void clock_update_page() {
+    struct clock_page *page = clock_page_begin();
+    if (!page) {
+        return;
+    }
+    page->ticks = ticks;
+    if (tsc_khz) {
+        page->base_tsc = base_tsc;
+        page->base_ns = base_ns;
+        page->base_frac = base_frac;
+    } else {
+        page->base_ns = clock_read_ns();
+    }
+    clock_page_end();
+}
+
+void clock_set_wall(struct rtc_time *t) {
+    struct clock_page *page = clock_page_begin();
+    if (page) {
+        page->wall = *t;
+        clock_page_end();
+    }
+}
+
+// Drawing the cursor is too slow for the tick interrupt
+static void clock_heartbeat(void *arg) {
+    console_heartbeat();
+}
+
+static struct work heartbeat_work = WORK_INIT(clock_heartbeat, 0);
+
+static void clock_advance(uint32_t n) {
+    ticks += n;
+    clicks += n;
+    if (clicks >= CLOCK_HZ) {
+        clicks %= CLOCK_HZ;
+        work_schedule(&heartbeat_work);
+    }
+}
 
 static void clock_interrupt(int i, int code) {
-    clicks++;
-    process_wakeup_all(&queue);
-    if (clicks >= CLICKS_PER_SECOND) {
-        clicks = 0;
-        seconds++;
-        console_heartbeat();
-        process_preempt();
+    if (tsc_khz) {
+        clock_rebase();
+    }
+    if (oneshot) {
+        // The one-shot ended on a tick boundary, so the periodic tick
+        // resumes in phase
+        oneshot = 0;
+        clock_advance(oneshot_ticks);
+        clockevent->set_periodic(tick_count);
+    } else {
+        clock_advance(1);
+    }
+    clock_update_page();
+    timer_expire(ticks);
+    process_tick();
+}
+
+uint64_t clock_read_cycles() {
+    return tsc_khz ? cpu_read_tsc() : 0;
+}
+
+uint64_t clock_read_ns() {
+    uint64_t ns;
+    unsigned flags = interrupt_save();
+    if (tsc_khz) {
+        ns = clock_tsc_ns(cpu_read_tsc());
+    } else {
+        // Whole ticks, plus the part of the current one the PIT has counted
+        ns = (uint64_t)(ticks / CLOCK_HZ) * 1000000000 +
+             clock_div64((uint64_t)(ticks % CLOCK_HZ) * 1000000000,
+                         CLOCK_HZ, 0);
+        if (clockevent && !oneshot) {
+            uint32_t counted = tick_count - clockevent->read();
+            ns += clock_div64((uint64_t)counted * 1000000000,
+                              clockevent->freq, 0);
+        }
+    }
+    // A tick that is pending but not handled yet could make the time go
+    // back, as could rounding when the base moves
+    if (ns < last_ns) {
+        ns = last_ns;
     }
+    last_ns = ns;
+    interrupt_restore(flags);
+    return ns;
+}
+
+uint32_t clock_tsc_khz() {
+    return tsc_khz;
 }
 
 clock_t clock_read() {
     clock_t result;
-    result.seconds = seconds;
-    result.millis = 1000 * clicks / CLICKS_PER_SECOND;
+    uint32_t rem;
+    result.seconds = clock_div64(clock_read_ns(), 1000000000, &rem);
+    result.millis = rem / 1000000;
     return result;
 }
 
+uint32_t clock_ticks() {
+    return ticks;
+}
+
 clock_t clock_diff(clock_t start, clock_t stop) {
     clock_t result;
     if (stop.millis < start.millis) {
@@ -52,27 +210,106 @@ clock_t clock_diff(clock_t start, clock_t stop) {
     return result;
 }
 
+static void clock_wakeup(void *queue) {
+    process_wakeup((struct list *)queue);
+}
+
 void clock_wait(uint32_t millis) {
-    clock_t start, elapsed;
-    uint32_t total;
+    struct list queue = { 0, 0 };
+    struct timer t;
+
+    // Sleep for one tick at least, as callers polling a device expect
+    uint32_t deadline = ticks + CLOCK_MS_TO_TICKS(millis);
+    if (deadline == ticks) {
+        deadline++;
+    }
 
-    start = clock_read();
-    do {
-        process_wait(&queue);
-        elapsed = clock_diff(start, clock_read());
-        total = elapsed.millis + elapsed.seconds * 1000;
-    } while (total < millis);
+    timer_init(&t, clock_wakeup, &queue);
+    while ((int32_t)(ticks - deadline) < 0) {
+        // The timer must not fire before the process is on the queue
+        interrupt_block();
+        if (timer_add(&t, deadline)) {
+            process_wait(&queue);
+        } else {
+            interrupt_unblock();
+            process_yield();
+        }
+    }
+}
+
+void clock_stop_tick() {
+    if (oneshot) {
+        return;
+    }
+
+    uint32_t n = timer_next(ticks);
+    uint32_t max = clockevent->max_count / tick_count;
+    if (n > max) {
+        n = max;
+    }
+    if (n < 2) {
+        return;
+    }
+
+    uint32_t first = clockevent->read();
+    if (first < TICK_MARGIN) {
+        return;
+    }
+    oneshot = 1;
+    oneshot_ticks = n;
+    oneshot_first = first;
+    clockevent->set_oneshot(first + (n - 1) * tick_count);
+}
+
+void clock_restart_tick() {
+    if (!oneshot) {
+        return;
+    }
+
+    // Once the one-shot is over or about to be, its interrupt restarts the
+    // tick by itself
+    uint32_t left = clockevent->read();
+    if (left < TICK_MARGIN) {
+        return;
+    }
+
+    // Count the ticks that went by, and finish the one in progress with
+    // another one-shot, which then resumes the periodic tick
+    uint32_t elapsed = oneshot_first + (oneshot_ticks - 1) * tick_count - left;
+    if (elapsed >= oneshot_first) {
+        clock_advance(1 + (elapsed - oneshot_first) / tick_count);
+        clock_update_page();
+    }
+    oneshot_ticks = 1;
+    oneshot_first = (left - 1) % tick_count + 1;
+    clockevent->set_oneshot(oneshot_first);
 }
 
 void clock_init() {
-    outb(SQUARE_WAVE, TIMER_MODE);
-    outb((TIMER_COUNT & 0xff), TIMER0);
-    outb((TIMER_COUNT >> 8) & 0xff, TIMER0);
+    clock_calibrate_tsc();
+
+    clock_page_init();
+    struct clock_page *page = clock_page_begin();
+    page->tsc_khz = tsc_khz;
+    page->tsc_mult = tsc_mult;
+    page->tsc_shift = TSC_SHIFT;
+    clock_page_end();
+    clock_update_page();
+    struct rtc_time now;
+    rtc_read(&now);
+    clock_set_wall(&now);
 
-    interrupt_register(32, clock_interrupt);
-    interrupt_enable(32);
+    clockevent = pit_clockevent();
+    tick_count = (clockevent->freq + CLOCK_HZ / 2) / CLOCK_HZ;
+    clockevent->set_periodic(tick_count);
 
-    console_printf("clock: ticking\n");
+    interrupt_register(clockevent->irq, clock_interrupt);
+    interrupt_enable(clockevent->irq);
+
+    console_printf("clock: %s ticking at %d Hz\n", clockevent->name, CLOCK_HZ);
+    if (tsc_khz) {
+        console_printf("clock: tsc running at %d MHz\n", tsc_khz / 1000);
+    }
 }
 
 int clock_compare(clock_t a, clock_t b) {
@@ -9,9 +9,77 @@ See the file LICENSE for details.
 
 #include "kerneltypes.h"
 #include "sys_clock_struct.h"
+#include "sys_rtc_struct.h"
+
+/*
+ * Rate of the timer interrupt, in ticks per second. It can be set at build
+ * time, as in "make HZ=250", to anything from 100 to 1000.
+ */
+#ifndef CLOCK_HZ
+#define CLOCK_HZ 1000
+#endif
+
+#if CLOCK_HZ < 100 || CLOCK_HZ > 1000
+#error "CLOCK_HZ must be between 100 and 1000"
+#endif
+
+// Number of ticks in a span of milliseconds, rounded up
+#define CLOCK_MS_TO_TICKS(ms) \
+    ((ms) / 1000 * CLOCK_HZ + ((ms) % 1000 * CLOCK_HZ + 999) / 1000)
 
 void clock_init();
 clock_t clock_read();
+
+/**
+ * @brief   Number of timer ticks since the clock was started
+ */
+uint32_t clock_ticks();
+
+/**
+ * @brief   Nanoseconds since the clock was started
+ * @details Counted by the TSC when the processor has one, calibrated against
+ *          the PIT at boot, and by the tick count and the PIT otherwise. The
+ *          result never goes back. clock_read is built on it.
+ */
+uint64_t clock_read_ns();
+
+/**
+ * @brief   Read the raw TSC for fine grained measurements
+ *
+ * @return  The cycle count, or 0 without a usable TSC
+ */
+uint64_t clock_read_cycles();
+
+/**
+ * @brief   Frequency of the TSC measured at boot, in kHz
+ *
+ * @return  The frequency, or 0 without a usable TSC
+ */
+uint32_t clock_tsc_khz();
+
+/**
+ * @brief   Publish the calendar time read from the RTC to user processes
+ *
+ * @param   t   The current time
+ */
+void clock_set_wall(struct rtc_time *t);
+
+/**
+ * @brief   Stop the periodic tick before the CPU goes idle
+ * @details Programs the timer in one-shot mode to fire at the deadline of
+ *          the earliest kernel timer, or as late as the timer allows if none
+ *          is pending, so that an idle CPU is not woken up on every tick. Must be called with interrupts blocked.
+ */
+void clock_stop_tick();
+
+/**
+ * @brief   Resume the periodic tick once the CPU is no longer idle
+ * @details Accounts for the ticks that went by while the tick was stopped.
+ *          Does nothing if the one-shot fired already. Must be called with
+ *          interrupts blocked.
+ */
+void clock_restart_tick();
+
 clock_t clock_diff(clock_t start, clock_t stop);
 void clock_wait(uint32_t millis);
 
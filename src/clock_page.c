@@ -0,0 +1,38 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "clock_page.h"
+#include "clock.h"
+#include "memory_raw.h"
+#include "memorylayout.h"
+
+static struct clock_page *page = 0;
+
+void clock_page_init() {
+    page = memory_alloc_page(1);
+    memory_frame_page((uint32_t)page >> PAGE_BITS)->flags |= PAGE_STATE_PINNED;
+    page->hz = CLOCK_HZ;
+}
+
+int clock_page_map(struct pagetable *p) {
+    // Not a PAGE_FLAG_ALLOC mapping, so the page outlives the process
+    return pagetable_map(p, PROCESS_CLOCK_PAGE, (unsigned)page,
+                         PAGE_FLAG_USER | PAGE_FLAG_READONLY);
+}
+
+struct clock_page *clock_page_begin() {
+    if (!page) {
+        return 0;
+    }
+    page->sequence++;
+    asm volatile("" : : : "memory");
+    return page;
+}
+
+void clock_page_end() {
+    asm volatile("" : : : "memory");
+    page->sequence++;
+}
@@ -0,0 +1,43 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef CLOCK_PAGE_H
+#define CLOCK_PAGE_H
+
+#include "kerneltypes.h"
+#include "sys_clock_struct.h"
+#include "pagetable.h"
+
+/**
+ * @brief   Allocate the page that shares the time with user processes
+ * @details Must run before the first process is created.
+ */
+void clock_page_init();
+
+/**
+ * @brief   Map the clock page read-only at PROCESS_CLOCK_PAGE
+ *
+ * @param   p   The page table of a new process
+ * @return  1 on success, 0 if the page could not be mapped
+ */
+int clock_page_map(struct pagetable *p);
+
+/**
+ * @brief   Start updating the clock page
+ * @details Makes the sequence odd, so that readers retry. Updates must not
+ *          be interrupted by other updates, which holds as long as they are
+ *          made from interrupt handlers or with interrupts blocked.
+ *
+ * @return  The page to update, or 0 before clock_page_init
+ */
+struct clock_page *clock_page_begin();
+
+/**
+ * @brief   Publish an update started by clock_page_begin
+ */
+void clock_page_end();
+
+#endif
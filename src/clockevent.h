@@ -0,0 +1,35 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef CLOCKEVENT_H
+#define CLOCKEVENT_H
+
+#include "kerneltypes.h"
+
+/*
+ * A timer that can raise the clock interrupt, either periodically or once
+ * after a given delay. Delays are given in counts of the timer's own input
+ * clock, which runs at freq Hz. clock.c keeps the periodic tick while
+ * processes run, and switches to one-shot mode to sleep through idle time.
+ */
+struct clockevent {
+    const char *name;
+    uint32_t freq;          // counts per second
+    uint32_t max_count;     // longest delay of a single one-shot
+    int irq;                // interrupt vector raised by the timer
+
+    // Raise the interrupt every count counts
+    void (*set_periodic)(uint32_t count);
+
+    // Raise the interrupt once, count counts from now
+    void (*set_oneshot)(uint32_t count);
+
+    // Counts left before the next interrupt, or 0 once a one-shot has
+    // expired, whether or not its interrupt was handled yet
+    uint32_t (*read)();
+};
+
+#endif
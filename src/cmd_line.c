@@ -12,6 +12,10 @@ See the file LICENSE for details.
 #include "window.h"
 #include "graphics.h"
 #include "syscall.h"
+#include "module_tests.h"
+#include "kmalloc.h"
+#include "shrinker.h"
+#include "memory_raw.h"     // memory_report
 
 #define KEYBOARD_BUFFER_SIZE 256
 
@@ -68,6 +72,17 @@ void cmd_line_attempt(const char *line) {
         uint32_t identifier = permissions_capability_create();
         run("/BIN/TEST_CLO.NUN", identifier);
         permissions_capability_delete(identifier);
+    } else if (strcmp("memstat", first_word) == 0) {
+        memory_report();
+        kmalloc_report();
+        shrinker_report();
+    } else if (strcmp("string_bench", first_word) == 0) {
+        string_benchmark();
+    } else if (strcmp("switch_bench", first_word) == 0) {
+        uint32_t identifier = permissions_capability_create();
+        run("/BIN/TEST_SWI.NUN", identifier);
+        run("/BIN/TEST_SWI.NUN", identifier);
+        permissions_capability_delete(identifier);
     } else if (strcmp("help", first_word) == 0) {   // Leave this as the last case
         cmd_line_help(the_rest);
     } else if (strcmp("window_test", first_word) == 0) {
@@ -102,7 +117,10 @@ void print_all_functions() {
             "echo\n"
             "help\n"
             "ls\n"
+            "memstat\n"
             "pwd\n"
+            "string_bench\n"
+            "switch_bench\n"
             "test\n"
     );
 }
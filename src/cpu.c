@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "cpu.h"
+#include "console.h"
+
+// cpuid leaf 1, edx
+#define CPUID_1_EDX_TSC     (1 << 4)
+#define CPUID_1_EDX_FXSR    (1 << 24)
+#define CPUID_1_EDX_SSE     (1 << 25)
+#define CPUID_1_EDX_SSE2    (1 << 26)
+
+// cpuid leaf 7, ebx
+#define CPUID_7_EBX_ERMSB   (1 << 9)
+
+#define EFLAGS_ID           (1 << 21)
+
+#define CR0_MP              (1 << 1)
+#define CR0_EM              (1 << 2)
+#define CR4_OSFXSR          (1 << 9)
+#define CR4_OSXMMEXCPT      (1 << 10)
+
+static uint32_t cpu_features = 0;
+
+static void cpu_cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c,
+                      uint32_t *d) {
+    asm volatile("cpuid"
+                 : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                 : "a"(leaf), "c"(0));
+}
+
+// The cpuid instruction exists when the ID flag of eflags can be changed
+static int cpu_has_cpuid() {
+    uint32_t before, after;
+    asm volatile("pushfl\n\t"
+                 "pushfl\n\t"
+                 "popl %0\n\t"
+                 "movl %0, %1\n\t"
+                 "xorl %2, %1\n\t"
+                 "pushl %1\n\t"
+                 "popfl\n\t"
+                 "pushfl\n\t"
+                 "popl %1\n\t"
+                 "popfl"
+                 : "=&r"(before), "=&r"(after)
+                 : "i"(EFLAGS_ID)
+                 : "cc");
+    return ((before ^ after) & EFLAGS_ID) != 0;
+}
+
+// Let SSE instructions run. fpu.c switches their state between processes,
+// and the kernel must wrap its own uses in fpu_kernel_begin and _end.
+static void cpu_enable_sse() {
+    uint32_t cr0, cr4;
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+    asm volatile("movl %0, %%cr0" : : "r"(cr0));
+    asm volatile("movl %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile("movl %0, %%cr4" : : "r"(cr4));
+}
+
+void cpu_init() {
+    uint32_t max_leaf, a, b, c, d;
+    char vendor[13];
+
+    if (!cpu_has_cpuid()) {
+        console_printf("cpu: no cpuid, assuming a plain i386\n");
+        return;
+    }
+    cpu_features |= CPU_FEATURE_CPUID;
+
+    cpu_cpuid(0, &max_leaf, &b, &c, &d);
+    *(uint32_t *)&vendor[0] = b;
+    *(uint32_t *)&vendor[4] = d;
+    *(uint32_t *)&vendor[8] = c;
+    vendor[12] = 0;
+
+    if (max_leaf >= 1) {
+        cpu_cpuid(1, &a, &b, &c, &d);
+        if (d & CPUID_1_EDX_TSC) {
+            cpu_features |= CPU_FEATURE_TSC;
+        }
+        if (d & CPUID_1_EDX_FXSR) {
+            cpu_features |= CPU_FEATURE_FXSR;
+        }
+        if ((d & CPUID_1_EDX_SSE) && (d & CPUID_1_EDX_FXSR)) {
+            cpu_features |= CPU_FEATURE_SSE;
+            if (d & CPUID_1_EDX_SSE2) {
+                cpu_features |= CPU_FEATURE_SSE2;
+            }
+        }
+    }
+    if (max_leaf >= 7) {
+        cpu_cpuid(7, &a, &b, &c, &d);
+        if (b & CPUID_7_EBX_ERMSB) {
+            cpu_features |= CPU_FEATURE_ERMSB;
+        }
+    }
+
+    if (cpu_features & CPU_FEATURE_SSE) {
+        cpu_enable_sse();
+    }
+
+    console_printf("cpu: %s%s%s%s%s\n", vendor,
+                   (cpu_features & CPU_FEATURE_TSC) ? " tsc" : "",
+                   (cpu_features & CPU_FEATURE_SSE) ? " sse" : "",
+                   (cpu_features & CPU_FEATURE_SSE2) ? " sse2" : "",
+                   (cpu_features & CPU_FEATURE_ERMSB) ? " ermsb" : "");
+}
+
+int cpu_has(uint32_t features) {
+    return (cpu_features & features) == features;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "kerneltypes.h"
+
+// Features reported by cpu_has
+#define CPU_FEATURE_CPUID   0x01    // the cpuid instruction itself
+#define CPU_FEATURE_TSC     0x02    // rdtsc
+#define CPU_FEATURE_FXSR    0x04    // fxsave and fxrstor
+#define CPU_FEATURE_SSE     0x08
+#define CPU_FEATURE_SSE2    0x10
+#define CPU_FEATURE_ERMSB   0x20    // fast rep movsb and rep stosb
+
+/**
+ * @brief   Probe the processor
+ * @details Reads the features of the processor with cpuid, when it has the
+ *          instruction, and turns on SSE when it is available. This must run
+ *          before anything calls cpu_has.
+ */
+void cpu_init();
+
+/**
+ * @brief   Test for processor features
+ *
+ * @param   features    One or more CPU_FEATURE_ flags
+ * @return  1 if the processor has all of them; 0 otherwise
+ */
+int cpu_has(uint32_t features);
+
+/**
+ * @brief   Read the time stamp counter
+ * @details Only meaningful when cpu_has(CPU_FEATURE_TSC).
+ *
+ * @return  The number of cycles since the processor was reset
+ */
+static inline uint64_t cpu_read_tsc() {
+    uint64_t tsc;
+    asm volatile("rdtsc" : "=A"(tsc));
+    return tsc;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "fpu.h"
+#include "cpu.h"
+#include "console.h"
+#include "interrupt.h"
+#include "process.h"
+
+#define CR0_MP              (1 << 1)
+#define CR0_EM              (1 << 2)
+#define CR0_TS              (1 << 3)
+
+#define FPU_EXCEPTION       7   // device not available
+#define MXCSR_DEFAULT       0x1f80
+
+// The process whose state is in the registers, if any
+static struct process *fpu_owner = 0;
+static int fpu_ready = 0;
+
+static inline void fpu_clts() {
+    asm volatile("clts");
+}
+
+static inline void fpu_stts() {
+    uint32_t cr0;
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+struct fpu_state {
+    uint8_t data[FPU_STATE_SIZE];
+};
+
+// The 16 byte aligned save area of a process
+static struct fpu_state *fpu_state(struct process *p) {
+    return (struct fpu_state *)(((uint32_t)p->fpu_area + 15) & ~15);
+}
+
+static void fpu_save(struct fpu_state *s) {
+    if (cpu_has(CPU_FEATURE_FXSR)) {
+        asm volatile("fxsave %0" : "=m"(*s));
+    } else {
+        asm volatile("fnsave %0\n\t"
+                     "fwait"
+                     : "=m"(*s));
+    }
+}
+
+static void fpu_restore(struct fpu_state *s) {
+    if (cpu_has(CPU_FEATURE_FXSR)) {
+        asm volatile("fxrstor %0" : : "m"(*s));
+    } else {
+        asm volatile("frstor %0" : : "m"(*s));
+    }
+}
+
+static void fpu_reset() {
+    asm volatile("fninit");
+    if (cpu_has(CPU_FEATURE_SSE)) {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+// Put the owner's registers away, so that they can be reused
+static void fpu_evict() {
+    if (fpu_owner) {
+        fpu_save(fpu_state(fpu_owner));
+        fpu_owner = 0;
+    }
+}
+
+static void fpu_handle_unavailable(int intr, int code) {
+    fpu_clts();
+    if (fpu_owner == current) {
+        return;
+    }
+    fpu_evict();
+    if (!current) {
+        // The idle loop: hand out clean registers that nobody owns
+        fpu_reset();
+        return;
+    }
+    if (current->fpu_used) {
+        fpu_restore(fpu_state(current));
+    } else {
+        fpu_reset();
+        current->fpu_used = 1;
+    }
+    fpu_owner = current;
+}
+
+void fpu_init() {
+    uint32_t cr0;
+    asm volatile("movl %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP;
+    asm volatile("movl %0, %%cr0" : : "r"(cr0));
+    fpu_reset();
+
+    interrupt_register(FPU_EXCEPTION, fpu_handle_unavailable);
+    fpu_ready = 1;
+
+    console_printf("fpu: lazy switching with %s\n",
+                   cpu_has(CPU_FEATURE_FXSR) ? "fxsave" : "fnsave");
+}
+
+void fpu_switch(struct process *p) {
+    if (!fpu_ready) {
+        return;
+    }
+    if (p && p == fpu_owner) {
+        fpu_clts();
+    } else {
+        fpu_stts();
+    }
+}
+
+void fpu_release(struct process *p) {
+    if (fpu_owner == p) {
+        fpu_owner = 0;
+    }
+}
+
+unsigned fpu_kernel_begin() {
+    unsigned flags = interrupt_save();
+    if (fpu_ready) {
+        fpu_clts();
+        fpu_evict();
+    }
+    return flags;
+}
+
+void fpu_kernel_end(unsigned flags) {
+    // Nobody owns the registers now, so the next user traps and reloads
+    if (fpu_ready) {
+        fpu_stts();
+    }
+    interrupt_restore(flags);
+}
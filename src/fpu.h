@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef FPU_H
+#define FPU_H
+
+#include "kerneltypes.h"
+
+/*
+The x87 and SSE registers are switched lazily. Only one process, the owner,
+has its state in the registers. Switching to any other process sets CR0.TS,
+so its first FPU instruction raises a device-not-available exception, and
+only then is the owner's state saved and the new process's state loaded.
+Processes that never touch the FPU never pay for it.
+*/
+
+// Large enough for fxsave; fnsave only needs 108 bytes
+#define FPU_STATE_SIZE 512
+
+// fxsave needs 16 byte alignment, which structures packed by kerneltypes.h
+// cannot promise, so the area has room to align the state inside it
+#define FPU_AREA_SIZE (FPU_STATE_SIZE + 15)
+
+struct process;
+
+/**
+ * @brief   Turn on lazy FPU switching
+ * @details Resets the FPU and installs the device-not-available handler.
+ *          Must run after interrupt_init and cpu_init.
+ */
+void fpu_init();
+
+/**
+ * @brief   Prepare the FPU for the process about to run
+ * @details Clears CR0.TS when the process already owns the registers, and
+ *          sets it otherwise. Called by the scheduler with interrupts off.
+ *
+ * @param   p   The next process
+ */
+void fpu_switch(struct process *p);
+
+/**
+ * @brief   Forget a process that is going away
+ *
+ * @param   p   The exiting process
+ */
+void fpu_release(struct process *p);
+
+/**
+ * @brief   Let the kernel use the FPU or the xmm registers
+ * @details Blocks interrupts, saves the owner's registers if they are live,
+ *          and clears CR0.TS. Keep the section short, and never fault or
+ *          sleep inside it.
+ *
+ * @return  The interrupt state to give to fpu_kernel_end
+ */
+unsigned fpu_kernel_begin();
+
+/**
+ * @brief   End a section started by fpu_kernel_begin
+ *
+ * @param   flags   The value returned by fpu_kernel_begin
+ */
+void fpu_kernel_end(unsigned flags);
+
+#endif
@@ -11,6 +11,8 @@ See the file LICENSE for details.
 #include "iso.h"
 #include "console.h"
 #include "sys_fs_err.h"
+#include "fs_allowance_trie.h"
+#include "bitmap.h"
 
 #define READ 4
 #define WRITE 2
@@ -18,40 +20,135 @@ See the file LICENSE for details.
 
 int32_t fs_security_check(const char *path);
 
-#define MAX_OS_OPEN_FILES 1024
+#define OPEN_FILES_TABLE_INITIAL_SIZE 64
+#define FD_TABLE_INITIAL_SIZE 16
+
+// The system-wide table of open files. Both it and the per-process fd tables
+// double in size when full, and keep a bitmap where a set bit marks a free
+// slot, so that a free slot is found with a find-first-set instead of a scan.
+static struct fs_agnostic_file **open_files_table = 0;
+static uint32_t *open_files_free = 0;
+static uint32_t open_files_table_size = 0;
+
+// Doubles a table of slot_size byte slots along with its bitmap of free slots
+static bool fs_grow_table(void **table, uint32_t **free_map, uint32_t *size,
+                          uint32_t initial_size, uint32_t slot_size) {
+    uint32_t old_size = *size;
+    uint32_t new_size = old_size ? old_size * 2 : initial_size;
+
+    void *new_table = kmalloc(new_size * slot_size);
+    uint32_t *new_free_map = kmalloc(BITMAP_CELLS(new_size) * sizeof(uint32_t));
+    if (!new_table || !new_free_map) {
+        kfree(new_table);
+        kfree(new_free_map);
+        return 0;
+    }
 
-struct fs_agnostic_file open_files_table[MAX_OS_OPEN_FILES];
+    memset(new_table, 0, new_size * slot_size);
+    memset(new_free_map, 0, BITMAP_CELLS(new_size) * sizeof(uint32_t));
+    if (old_size) {
+        memcpy(new_table, *table, old_size * slot_size);
+        memcpy(new_free_map, *free_map, BITMAP_CELLS(old_size) * sizeof(uint32_t));
+    }
+    uint32_t i;
+    for (i = old_size; i < new_size; i++) {
+        bitmap_set(new_free_map, i);
+    }
 
-/*
- * A dummy function to help us in our debugging
- */
-void fs_print_allowances() {
-    struct list_node *iterator = current->fs_allowances_list.head;
-    while (iterator) {
-        console_printf("%s -> ", ((struct fs_allowance *)iterator)->path);
-        iterator = iterator->next;
-    }
-    console_printf("\n");
+    kfree(*table);
+    kfree(*free_map);
+    *table = new_table;
+    *free_map = new_free_map;
+    *size = new_size;
+    return 1;
+}
+
+// Claims the lowest free slot of a table, growing the table if it is full
+static int32_t fs_alloc_slot(void **table, uint32_t **free_map, uint32_t *size,
+                             uint32_t initial_size, uint32_t slot_size) {
+    int32_t slot = -1;
+    if (*size) {
+        slot = bitmap_first_set(*free_map, BITMAP_CELLS(*size));
+    }
+    if (slot < 0) {
+        slot = *size;
+        if (!fs_grow_table(table, free_map, size, initial_size, slot_size)) {
+            return -1;
+        }
+    }
+    bitmap_clear(*free_map, slot);
+    return slot;
+}
+
+// Drops a reference on an open file, closing it with the last one
+static void fs_file_put(struct fs_agnostic_file *fp) {
+    fp->refcount--;
+    if (fp->refcount > 0) {
+        return;
+    }
+
+    switch (fp->ata_type) {
+        case ISO:
+            iso_fclose((struct iso_file *)fp->filep);
+            break;
+        default:
+            break;
+    }
+    open_files_table[fp->table_index] = 0;
+    bitmap_set(open_files_free, fp->table_index);
+    kfree(fp);
 }
 
-void fs_sys_init_open_files_table() {
-    int i;
-    for (i = 0; i < MAX_OS_OPEN_FILES; i++) {
-        open_files_table[i].filep = 0;  // Set each file pointer to null
+static int32_t fs_close_fd(struct process *p, uint32_t fd) {
+    if (fd >= p->fd_table_size) {
+        return ERR_FD_OOR;
+    }
+    if (!p->fd_table[fd].is_open) {
+        return ERR_WAS_NOT_OPEN;
     }
+
+    fs_file_put(p->fd_table[fd].ptr);
+    p->fd_table[fd].ptr = 0;
+    p->fd_table[fd].is_open = 0;
+    p->fd_table[fd].access = 0;
+    bitmap_set(p->fd_free, fd);
+    return 0;
 }
 
 void fs_init_security(struct process *p) {
-    // Initialize all file descriptor slots to 0
-    int i;
-    for (i = 0; i < PROCESS_MAX_OPEN_FILES; i++) {
-        p->fd_table[i].is_open = 0;
-        p->fd_table[i].ptr = 0;
+    // Start with a small table of file descriptors, all of them free
+    p->fd_table = 0;
+    p->fd_free = 0;
+    p->fd_table_size = 0;
+    fs_grow_table((void **)&(p->fd_table), &(p->fd_free), &(p->fd_table_size),
+                  FD_TABLE_INITIAL_SIZE, sizeof(struct fd));
+
+    // Allowances are compiled once the permissions are known
+    p->fs_allowances = 0;
+}
+
+void fs_cleanup(struct process *p) {
+    uint32_t fd;
+    for (fd = 0; fd < p->fd_table_size; fd++) {
+        if (p->fd_table[fd].is_open) {
+            fs_close_fd(p, fd);
+        }
     }
+    kfree(p->fd_table);
+    kfree(p->fd_free);
+    p->fd_table = 0;
+    p->fd_free = 0;
+    p->fd_table_size = 0;
+}
 
-    //Temporarily copy the entire list so that the in place checks work out
-    fs_copy_allowances_list(&(p->fs_allowances_list), &(p->permissions->fs_allowances));
+void fs_compile_allowances(struct process *p) {
+    fs_allowance_trie_free(p->fs_allowances);
+    p->fs_allowances = fs_allowance_trie_build(&(p->permissions->fs_allowances));
+}
 
+void fs_free_allowances(struct process *p) {
+    fs_allowance_trie_free(p->fs_allowances);
+    p->fs_allowances = 0;
 }
 
 // Look at the OS's table of open files to see if read write conflicts
@@ -114,16 +211,15 @@ int mode_str_to_int(const char *mode) {
 }
 
 struct fs_agnostic_file *create_fs_agnostic_file(enum ata_kind ata_type, uint8_t ata_unit, const char *path, uint8_t mode) {
-    int next_open_slot;
-    for (next_open_slot = 0; next_open_slot < MAX_OS_OPEN_FILES; next_open_slot++) {
-        if (!open_files_table[next_open_slot].filep) {  // If the file pointer hasn't been assigned, this is an unused file slot
-            break;
-        }
+    struct fs_agnostic_file *new_file = kmalloc(sizeof(*new_file));
+    if (!new_file) {
+        return 0;
     }
-    struct fs_agnostic_file *new_file = &(open_files_table[next_open_slot]);
     new_file->ata_unit = ata_unit;
     new_file->ata_type = ata_type;
     new_file->mode = mode;
+    new_file->at_EOF = 0;
+    new_file->refcount = 1;
     strcpy(new_file->path, path);
     switch (ata_type) {
         case ISO:
@@ -138,6 +234,18 @@ struct fs_agnostic_file *create_fs_agnostic_file(enum ata_kind ata_type, uint8_t
         kfree(new_file);
         return 0;
     }
+
+    int32_t slot = fs_alloc_slot((void **)&open_files_table, &open_files_free,
+                                 &open_files_table_size,
+                                 OPEN_FILES_TABLE_INITIAL_SIZE,
+                                 sizeof(*open_files_table));
+    if (slot < 0) {
+        iso_fclose((struct iso_file *)new_file->filep);
+        kfree(new_file);
+        return 0;
+    }
+    new_file->table_index = slot;
+    open_files_table[slot] = new_file;
     return new_file;
 }
 
@@ -173,60 +281,37 @@ int32_t fs_open(const char *path, const char *mode) {
 
     enum ata_kind ata_type = map_media_to_driver_id(ata_unit);
 
-    int next_fd;
-    //find current's next available fd by 'files' member
-    //add to process file->file table
-    bool opened = 0;
-    for (next_fd = 0; opened == 0 && next_fd < PROCESS_MAX_OPEN_FILES; next_fd++) {
-        // See if the process's file descriptor table has an unopen slot
-        if (!current->fd_table[next_fd].is_open) {
-            //make new sys level file
-            //mark it with the ata type
-            //the ata unit
-            //and a pointer to the union of below
-            //sys level file types
-
-            // Create a fs_agnostic_file and give its reference to the process fd_table
-            current->fd_table[next_fd].ptr = create_fs_agnostic_file(ata_type, ata_unit, media_path, imode);
-            if (current->fd_table[next_fd].ptr) {
-                current->fd_table[next_fd].is_open = 1;
-            } else {
-                return ERR_KERNEL_OPEN_FAIL;
-            }
-        } else if (next_fd == PROCESS_MAX_OPEN_FILES - 1) {
-            return ERR_FDS_EXCEEDED;
-        }
+    //find current's lowest free fd, growing its table if all are in use
+    int32_t fd = fs_alloc_slot((void **)&(current->fd_table), &(current->fd_free),
+                               &(current->fd_table_size), FD_TABLE_INITIAL_SIZE,
+                               sizeof(struct fd));
+    if (fd < 0) {
+        return ERR_FDS_EXCEEDED;
     }
 
-    return next_fd;
+    // Create a fs_agnostic_file and give its reference to the process fd_table
+    struct fs_agnostic_file *fp = create_fs_agnostic_file(ata_type, ata_unit, media_path, imode);
+    if (!fp) {
+        bitmap_set(current->fd_free, fd);
+        return ERR_KERNEL_OPEN_FAIL;
+    }
+
+    // The allowance was checked above; the fd remembers the
+    // outcome so reads don't have to check again
+    current->fd_table[fd].ptr = fp;
+    current->fd_table[fd].is_open = 1;
+    current->fd_table[fd].access = imode;
+
+    return fd;
 }
 
 int32_t fs_close(uint32_t fd) {
-    if (fd >= PROCESS_MAX_OPEN_FILES) {
-        return ERR_FD_OOR;
-    }
-
-    struct fs_agnostic_file *fp = current->fd_table[fd].ptr;
-    if (fp) {
-        switch (fp->ata_type) {
-            case 1:  //ISO
-                iso_fclose((struct iso_file *)fp);
-                break;
-            default:
-                return ERR_BAD_ATA_KIND;
-        }
-        fp->filep = 0;
-        current->fd_table[fd].ptr = 0;
-        current->fd_table[fd].is_open = 0;
-        return 0;
-    } else {
-        return ERR_WAS_NOT_OPEN;
-    }
+    return fs_close_fd(current, fd);
 }
 
 int32_t fs_read(char *dest, uint32_t bytes, uint32_t fd) {
     int bytes_read = 0;
-    if (fd >= PROCESS_MAX_OPEN_FILES) {
+    if (fd >= current->fd_table_size) {
         return ERR_FD_OOR;
     }
 
@@ -234,11 +319,8 @@ int32_t fs_read(char *dest, uint32_t bytes, uint32_t fd) {
     if (!fp || current->fd_table[fd].is_open == 0) {
         return ERR_WAS_NOT_OPEN;
     }
-    //must be okay with security and be allowed to read
-    if (!fs_security_check(fp->path)) {
-        return ERR_NO_ALLOWANCE;
-    }
-    if (!(fp->mode & READ)) {
+    //security was checked at open, only the granted mode matters here
+    if (!(current->fd_table[fd].access & READ)) {
         return ERR_BAD_ACCESS_MODE;
     }
     switch (fp->ata_type) {
@@ -253,6 +335,17 @@ int32_t fs_read(char *dest, uint32_t bytes, uint32_t fd) {
     return bytes_read;
 }
 
+struct fs_agnostic_file *fs_file_for_read(uint32_t fd) {
+    if (fd >= current->fd_table_size || !current->fd_table[fd].is_open) {
+        return 0;
+    }
+
+    if (!(current->fd_table[fd].access & READ)) {
+        return 0;
+    }
+    return current->fd_table[fd].ptr;
+}
+
 int32_t fs_write(const char *src, uint32_t bytes, uint32_t fd) {
     // TODO: we'll need a writable system.
     return ERR_BAD_ACCESS_MODE;
@@ -263,51 +356,8 @@ bool fs_owner_check(const char *path) {
     return 1;
 }
 
-/**
-* Truncate a copy of the given path to match the length
-* of the allowed->path. If these match and it's an allow_below
-* allowance, give permission. If it's not an allow_below
-
-* allowance, only return 1 on exact match.
-*/
-bool path_permitted_by_allowance(const char *path, struct fs_allowance *allowed) {
-    if (allowed->do_allow_below) {
-        uint32_t allowed_path_len = strlen(allowed->path);
-        char truncated_path[allowed_path_len + 1];
-        memcpy(truncated_path, path, allowed_path_len);
-        truncated_path[allowed_path_len] = '\0';
-        if (strcmp(allowed->path, truncated_path) == 0 &&
-           (path[allowed_path_len] == '/' || path[allowed_path_len] == 0)
-           ) {
-            // The allowance is above the requested path
-            return 1;
-        } else {
-            return 0;
-        }
-    } else {
-        //in this case, you're allowed to read dir contents
-        //but not access them
-        if (strcmp(allowed->path, path) == 0) {
-            return 1;
-        } else {
-            return 0;
-        }
-    }
-    return 0;
-}
-
 bool fs_allowance_check(const char *path) {
-    struct list_node *iterator = current->fs_allowances_list.head;
-    //iterate over list of allowances until we reach
-    //an acceptable one. otherwise return 0;
-    while (iterator) {
-        if (path_permitted_by_allowance(path, (struct fs_allowance *)iterator)) {
-            return 1;
-        } else {
-            iterator = iterator->next;
-        }
-    }
-    return 0;
+    return fs_allowance_trie_check(current->fs_allowances, path);
 }
 
 int32_t fs_security_check(const char *path) {
@@ -21,6 +21,8 @@ struct fs_agnostic_file {
     enum ata_kind ata_type;
     bool at_EOF;
     void *filep;
+    uint32_t refcount;     // number of file descriptors sharing this file
+    uint32_t table_index;  // slot in the system-wide open files table
     char path[256];
 };
 
@@ -77,13 +79,31 @@ int32_t fs_write(const char *src, uint32_t bytes,  uint32_t fd);
 
 /**
  * @brief Initializes security aspects for file system regarding a process
- * @details Creates a process's list of security allowances (currently default
- * root access) and an empty open files table.
+ * @details Creates an empty file descriptor table, which grows as files are
+ * opened. The allowances are compiled
+ * separately by fs_compile_allowances once the permissions are known.
  *
  * @param p A process which the initialization should occur on.
  */
 void fs_init_security(struct process *p);
 
+/**
+ * @brief Compiles the fs allowances of a process
+ * @details Builds the allowance trie of the process from the fs_allowances of
+ * its permissions. Opening a file checks the path against this trie once, and
+ * the outcome is kept in the file descriptor.
+ *
+ * @param p A process whose permissions have been set.
+ */
+void fs_compile_allowances(struct process *p);
+
+/**
+ * @brief Frees the compiled fs allowances of a process
+ *
+ * @param p The process whose allowance trie should be freed.
+ */
+void fs_free_allowances(struct process *p);
+
 /**
  * @brief Copies a list of fs_allowances
  * @details Allocates new space for each node and copies each node element for
@@ -102,10 +122,23 @@ void fs_copy_allowances_list(struct list *to, struct list *from);
  */
 void fs_free_allowances_list(struct list *to_free);
 
-/** 
- * @brief Initialize the open file table for the kernel
- * @details Initialize each fs_agnostic file to reflect an unopened file
+/**
+ * @brief Looks up an open file for reading
+ * @details Finds the open file behind a file descriptor of the current
+ * process, for kernel code that reads the file by other means than fs_read.
+ *
+ * @param fd The file descriptor of the file
+ * @return Pointer to the open file, or 0 if fd is not open for reading
+ */
+struct fs_agnostic_file *fs_file_for_read(uint32_t fd);
+
+/**
+ * @brief Closes every file of a process
+ * @details Drops the process' references on its open files and frees its
+ * file descriptor table. Used when a process exits.
+ *
+ * @param p The process whose files should be closed.
  */
-void fs_sys_init_open_file_table();
+void fs_cleanup(struct process *p);
 
 #endif
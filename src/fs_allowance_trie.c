@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "fs_allowance_trie.h"
+#include "sys_fs_structs.h"
+#include "kmalloc.h"
+#include "string.h"
+
+static struct fs_allowance_trie_node *fs_allowance_trie_node_create(const char *name, uint32_t length) {
+    struct fs_allowance_trie_node *n = kmalloc(sizeof(*n) + length);
+    if (!n) {
+        return 0;
+    }
+    n->child = 0;
+    n->sibling = 0;
+    n->allow_exact = 0;
+    n->allow_below = 0;
+    n->name_length = length;
+    memcpy(n->name, name, length);
+    return n;
+}
+
+static struct fs_allowance_trie_node *fs_allowance_trie_find_child(const struct fs_allowance_trie_node *parent, const char *name, uint32_t length) {
+    struct fs_allowance_trie_node *n;
+    for (n = parent->child; n; n = n->sibling) {
+        if (n->name_length == length && strncmp(n->name, name, length) == 0) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+// Returns the length of the path component at the start of path
+static uint32_t fs_allowance_trie_component_length(const char *path) {
+    uint32_t length = 0;
+    while (path[length] && path[length] != '/') {
+        length++;
+    }
+    return length;
+}
+
+static bool fs_allowance_trie_insert(struct fs_allowance_trie_node *root, const struct fs_allowance *allowance) {
+    struct fs_allowance_trie_node *node = root;
+    const char *path = allowance->path;
+
+    while (*path) {
+        if (*path == '/') {
+            path++;
+            continue;
+        }
+        uint32_t length = fs_allowance_trie_component_length(path);
+        struct fs_allowance_trie_node *next = fs_allowance_trie_find_child(node, path, length);
+        if (!next) {
+            next = fs_allowance_trie_node_create(path, length);
+            if (!next) {
+                return 0;
+            }
+            next->sibling = node->child;
+            node->child = next;
+        }
+        node = next;
+        path += length;
+    }
+
+    if (allowance->do_allow_below) {
+        node->allow_below = 1;
+    } else {
+        node->allow_exact = 1;
+    }
+    return 1;
+}
+
+struct fs_allowance_trie_node *fs_allowance_trie_build(struct list *allowances) {
+    struct fs_allowance_trie_node *root = fs_allowance_trie_node_create("", 0);
+    if (!root) {
+        return 0;
+    }
+
+    struct list_node *iterator;
+    for (iterator = allowances->head; iterator != 0; iterator = iterator->next) {
+        if (!fs_allowance_trie_insert(root, (struct fs_allowance *)iterator)) {
+            fs_allowance_trie_free(root);
+            return 0;
+        }
+    }
+    return root;
+}
+
+bool fs_allowance_trie_check(const struct fs_allowance_trie_node *root, const char *path) {
+    const struct fs_allowance_trie_node *node = root;
+    if (!node) {
+        return 0;
+    }
+
+    while (1) {
+        if (node->allow_below) {
+            return 1;
+        }
+        while (*path == '/') {
+            path++;
+        }
+        if (!*path) {
+            return node->allow_exact;
+        }
+        uint32_t length = fs_allowance_trie_component_length(path);
+        node = fs_allowance_trie_find_child(node, path, length);
+        if (!node) {
+            return 0;
+        }
+        path += length;
+    }
+}
+
+void fs_allowance_trie_free(struct fs_allowance_trie_node *root) {
+    while (root) {
+        struct fs_allowance_trie_node *sibling = root->sibling;
+        fs_allowance_trie_free(root->child);
+        kfree(root);
+        root = sibling;
+    }
+}
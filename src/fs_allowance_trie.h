@@ -0,0 +1,58 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef FS_ALLOWANCE_TRIE_H
+#define FS_ALLOWANCE_TRIE_H
+
+#include "kerneltypes.h"
+#include "list.h"
+
+/*
+ * A process' fs allowances compiled into a trie of path components. The root
+ * node stands for "/", and each child adds one component to the path of its
+ * parent. Checking a path walks the trie once, component by component, instead
+ * of comparing the path against every allowance.
+ */
+struct fs_allowance_trie_node {
+    struct fs_allowance_trie_node *child;   // first child
+    struct fs_allowance_trie_node *sibling; // next child of the same parent
+    bool allow_exact;   // the path of this node itself is allowed
+    bool allow_below;   // the path of this node and everything below is allowed
+    uint32_t name_length;
+    char name[];        // path component, not null terminated
+};
+
+/**
+ * @brief Compiles a list of fs_allowances into a trie
+ * @details Inserts the path of every allowance in the list into a new trie,
+ * recording whether it allows the path alone or everything below it as well.
+ *
+ * @param allowances A list of struct fs_allowance
+ * @return The root of the new trie, to be freed with fs_allowance_trie_free,
+ * or 0 if it could not be allocated
+ */
+struct fs_allowance_trie_node *fs_allowance_trie_build(struct list *allowances);
+
+/**
+ * @brief Checks whether a path is allowed by a trie
+ * @details Walks the components of the path down the trie. The path is allowed
+ * if it runs through a node allowing everything below it, or ends on a node
+ * allowing its exact path.
+ *
+ * @param root The root of the trie, may be 0 for no allowances at all
+ * @param path The absolute path to check
+ * @return 1 if the path is allowed, 0 otherwise
+ */
+bool fs_allowance_trie_check(const struct fs_allowance_trie_node *root, const char *path);
+
+/**
+ * @brief Frees a trie
+ *
+ * @param root The root of the trie to free, may be 0
+ */
+void fs_allowance_trie_free(struct fs_allowance_trie_node *root);
+
+#endif
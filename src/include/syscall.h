@@ -15,9 +15,11 @@ See the file LICENSE for details.
 #define SYSCALL_clock_read 4
 #define SYSCALL_sleep 5
 #define SYSCALL_rtc_read 6
+#define SYSCALL_setpriority 7
 
 #define SYSCALL_capability_create 50
 #define SYSCALL_capability_delete 51
+#define SYSCALL_capability_set_priority 52
 
 #define SYSCALL_window_create 200
 #define SYSCALL_window_set_border_color 201
@@ -32,6 +34,10 @@ See the file LICENSE for details.
 #define SYSCALL_memory_current_usage 400
 #define SYSCALL_memory_max 401
 #define SYSCALL_capability_set_max_memory 402
+#define SYSCALL_mmap 403
+#define SYSCALL_munmap 404
+#define SYSCALL_brk 405
+#define SYSCALL_madvise 406
 
 #define SYSCALL_open     601
 #define SYSCALL_close    602
@@ -12,6 +12,8 @@ See the file LICENSE for details.
 
 #include "pagetable.h"  // page fault exception handler
 
+#define EFLAGS_IF   (1 << 9)
+
 static interrupt_handler_t interrupt_handler_table[48];
 static uint32_t interrupt_count[48];
 static uint8_t interrupt_spurious[48];
@@ -121,6 +123,29 @@ void interrupt_unblock() {
     asm("sti");
 }
 
+unsigned interrupt_save() {
+    unsigned flags;
+    asm volatile("pushfl\n\t"
+                 "popl %0\n\t"
+                 "cli"
+                 : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void interrupt_restore(unsigned flags) {
+    asm volatile("pushl %0\n\t"
+                 "popfl"
+                 : : "r"(flags) : "memory", "cc");
+}
+
+int interrupt_enabled() {
+    unsigned flags;
+    asm volatile("pushfl\n\t"
+                 "popl %0"
+                 : "=r"(flags));
+    return (flags & EFLAGS_IF) != 0;
+}
+
 void interrupt_wait() {
     asm("sti");
     asm("hlt");
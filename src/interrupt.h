@@ -17,6 +17,33 @@ void interrupt_block();
 void interrupt_unblock();
 void interrupt_wait();
 
+/**
+ * @brief   Block interrupts, remembering whether they were blocked
+ * @details Unlike interrupt_block and interrupt_unblock, a pair of
+ *          interrupt_save and interrupt_restore can be used from interrupt
+ *          handlers, since interrupts stay blocked if they already were.
+ *
+ * @return  The flags to pass to interrupt_restore
+ */
+unsigned interrupt_save();
+
+/**
+ * @brief   Undo interrupt_save
+ *
+ * @param   flags   The value returned by interrupt_save
+ */
+void interrupt_restore(unsigned flags);
+
+/**
+ * @brief   Tell whether interrupts are enabled
+ * @details They are blocked in interrupt and exception handlers, system
+ *          calls, and sections between interrupt_block or interrupt_save and
+ *          the matching unblock or restore.
+ *
+ * @return  1 if interrupts are enabled, 0 if they are blocked
+ */
+int interrupt_enabled();
+
 /**
  * @brief   Dump a process after an interrupt
  * @details Dump a process after an interrupt. If the exception happened in
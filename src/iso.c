@@ -300,8 +300,12 @@ static int iso_media_read(void *dest, int elem_size, int num_elem, struct iso_po
     if (atapi_blocks_to_read > 1 ||
         global_atapi_extent != stream->cur_extent ||
         global_atapi_unit != stream->ata_unit) {
-        char buffer[atapi_blocks_to_read * ATAPI_BLOCKSIZE];
+        char *buffer = kmalloc(atapi_blocks_to_read * ATAPI_BLOCKSIZE);
+        if (!buffer) {
+            return -1;
+        }
         if (!atapi_read(stream->ata_unit, buffer, atapi_blocks_to_read, stream->cur_extent)) {
+            kfree(buffer);
             return -1;
         } else {
             //Do not start at the start of the buffer, because that is the start of
@@ -317,6 +321,7 @@ static int iso_media_read(void *dest, int elem_size, int num_elem, struct iso_po
             iso_media_seek(stream, bytes_needed, SEEK_CUR);
             global_atapi_unit = stream->ata_unit;
             global_atapi_extent = stream->cur_extent;
+            kfree(buffer);
             return num_elem;
         }
     } else {
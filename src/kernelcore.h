@@ -46,6 +46,23 @@ extern void reboot();
 
 extern void intr_return();
 
+struct pagetable;
+
+/**
+ * @brief   Switch to another kernel stack
+ * @details Saves the callee-saved registers and the stack pointer of the
+ *          running code, switches to next_pt when it is not already loaded,
+ *          and resumes the code that saved next_sp. Must be called with
+ *          interrupts blocked.
+ *
+ * @param   prev_sp Where to save the current stack pointer, or 0 to discard
+ *                  the current context
+ * @param   next_sp A stack pointer saved by switch_to, or a frame built by
+ *                  process_stack_init
+ * @param   next_pt The page table of the code to resume
+ */
+extern void switch_to(char **prev_sp, char *next_sp, struct pagetable *next_pt);
+
 extern void *interrupt_stack_pointer;
 
 #endif
@@ -11,10 +11,12 @@
 #define MEGA (KILO*KILO)
 #define GIGA (KILO*KILO*KILO)
 
+typedef long long int64_t;
 typedef int int32_t;
 typedef short int16_t;
 typedef char int8_t;
 
+typedef unsigned long long uint64_t;
 typedef unsigned int uint32_t;
 typedef unsigned short uint16_t;
 typedef unsigned char uint8_t;
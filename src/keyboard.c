@@ -12,6 +12,7 @@ See the file LICENSE for details.
 #include "kernelcore.h"
 #include "ps2.h"
 #include "window_manager.h"
+#include "workqueue.h"
 
 #define KEY_INVALID 0036
 
@@ -42,6 +43,14 @@ static int buffer_write = 0;
 
 static char str_buffer[KEYBOARD_BUFFER_SIZE];
 
+// Keys for the active window, until the worker turns them into events
+static char press_buffer[KEYBOARD_BUFFER_SIZE];
+static int press_read = 0;
+static int press_write = 0;
+
+static void keyboard_send_presses(void *arg);
+static struct work press_work = WORK_INIT(keyboard_send_presses, 0);
+
 static struct list queue = { 0, 0 };
 
 static int keyboard_scan() {
@@ -129,7 +138,13 @@ void keyboard_interrupt(int i, int code) {
     }
 
     if (active_window) {
-        send_event_keyboard_press(c);
+        int next = (press_write + 1) % KEYBOARD_BUFFER_SIZE;
+        if (next == press_read) {
+            return;
+        }
+        press_buffer[press_write] = c;
+        press_write = next;
+        work_schedule(&press_work);
     } else {
         if ((buffer_write + 1) == (buffer_read % KEYBOARD_BUFFER_SIZE)) {
             return;
@@ -140,6 +155,20 @@ void keyboard_interrupt(int i, int code) {
     }
 }
 
+static void keyboard_send_presses(void *arg) {
+    while (1) {
+        interrupt_block();
+        if (press_read == press_write) {
+            interrupt_unblock();
+            return;
+        }
+        char c = press_buffer[press_read];
+        press_read = (press_read + 1) % KEYBOARD_BUFFER_SIZE;
+        interrupt_unblock();
+        send_event_keyboard_press(c);
+    }
+}
+
 char keyboard_read() {
     int result;
     while (buffer_read == buffer_write) {
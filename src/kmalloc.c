@@ -11,13 +11,19 @@ See the file LICENSE for details.
 #include "memorylayout.h"
 #include "kernelcore.h"
 #include "memory_raw.h"
+#include "vmalloc.h"
+#include "kmalloc_stats.h"
 
 #define KMALLOC_SLOT_SIZE 8
 
 //462 is the size of a struct kmalloc_page_info.
 //It comes from x = 8 + 454, as pointer and max_free_gap sum to 8 bytes, then 4094 = (8 * x) + (8 + x)
 //where the first term is the space for the slots and the second is the sizeof(struct kmalloc_page_info)
-#define KMALLOC_NUM_SLOTS (PAGE_SIZE - 462)/KMALLOC_SLOT_SIZE
+#define KMALLOC_NUM_SLOTS ((PAGE_SIZE - 462) / KMALLOC_SLOT_SIZE)
+
+// The largest request that fits in the slots of one page, past which
+// requests are passed on to vmalloc
+#define KMALLOC_MAX_SIZE (KMALLOC_NUM_SLOTS * KMALLOC_SLOT_SIZE - sizeof(uint16_t))
 
 struct __attribute__((__packed__)) kmalloc_page_info {
     struct kmalloc_page_info *next;  // next page pointer
@@ -38,11 +44,16 @@ struct kmalloc_page_info *kmalloc_create_page_info(unsigned paddr) {
 /**
 * @brief Put a new page at the head of the kmalloc linked list of pages in use.
 * @details When kmalloc does not have sufficient space on any of the allocated pages on its linked list, this function helps it by using a new page from the pagetable, putting a struct kmalloc_page_info at the start of it, and inserting said page at the beginning of the linked list of pages.
+*
+* @return 1 on success, 0 if no page could be allocated
 */
-void kmalloc_get_page() {
+int kmalloc_get_page() {
     // Grab a new free page from memory
     // This marks the page as used
     unsigned phys_addr = (unsigned)memory_alloc_page(0);
+    if (!phys_addr) {
+        return 0;
+    }
 
     // build the page struct
     struct kmalloc_page_info *pg_info = kmalloc_create_page_info(phys_addr);
@@ -50,6 +61,7 @@ void kmalloc_get_page() {
     //rearrange the linked list of pages with the new page at the beginning.
     pg_info->next = kmalloc_head;
     kmalloc_head = pg_info;
+    return 1;
 }
 
 /**
@@ -107,7 +119,7 @@ int kmalloc_get_largest_gap_size(struct kmalloc_page_info *page_info) {
     return biggest_gap_in_slots;
 }
 
-void *kmalloc(unsigned int size) {
+static void *kmalloc_slots(unsigned int size) {
     uint16_t slots_needed = (size + sizeof(uint16_t)) / KMALLOC_SLOT_SIZE;
     //addresses integer division truncation
     if ((size + sizeof(uint16_t)) % KMALLOC_SLOT_SIZE) {
@@ -122,7 +134,9 @@ void *kmalloc(unsigned int size) {
 
     //If no such page exists, grab another!
     if (!page_info) {
-        kmalloc_get_page();
+        if (!kmalloc_get_page()) {
+            return 0;
+        }
         page_info = kmalloc_head;
     }
 
@@ -150,6 +164,20 @@ void *kmalloc(unsigned int size) {
     return (void *)(first_slot_phys_addr + sizeof(uint16_t));
 }
 
+void *kmalloc(unsigned int size) {
+    void *ptr;
+    if (size > KMALLOC_MAX_SIZE) {
+        ptr = vmalloc(size);
+    } else {
+        ptr = kmalloc_slots(size);
+    }
+
+#ifdef NUNYA_KMALLOC_STATS
+    kmalloc_stats_alloc(ptr, size, __builtin_return_address(0));
+#endif
+    return ptr;
+}
+
 /**
 * @brief Mark the memory being kfree'd as free in the kmalloc_page_info
 * @details Identifies the number of slots consumed by the pointer given as the mem_loc argument, and marks these as free in the page_info given.
@@ -176,6 +204,15 @@ void kfree(void *to_free) {
         return;
     }
 
+#ifdef NUNYA_KMALLOC_STATS
+    kmalloc_stats_free(to_free);
+#endif
+
+    if (vmalloc_owns(to_free)) {
+        vfree(to_free);
+        return;
+    }
+
     struct kmalloc_page_info *page_info = kmalloc_head;
     int is_freed = 0;
     while (page_info && is_freed == 0) {
@@ -201,3 +238,38 @@ void kfree(void *to_free) {
 
     return;
 }
+
+void kmalloc_report() {
+    uint32_t pages = 0, free_slots = 0, gap_slots = 0;
+    uint32_t occupancy[4] = {0, 0, 0, 0};
+    struct kmalloc_page_info *page_info;
+
+    for (page_info = kmalloc_head; page_info; page_info = page_info->next) {
+        uint32_t i, free = 0;
+        for (i = 0; i < KMALLOC_NUM_SLOTS; i++) {
+            free += page_info->free[i];
+        }
+        pages++;
+        free_slots += free;
+        gap_slots += page_info->max_free_gap;
+
+        uint32_t used = KMALLOC_NUM_SLOTS - free;
+        uint32_t quarter = used * 4 / KMALLOC_NUM_SLOTS;
+        occupancy[quarter < 4 ? quarter : 3]++;
+    }
+
+    console_printf("kmalloc: %d pages, %d bytes used, %d bytes free\n",
+                   pages, (pages * KMALLOC_NUM_SLOTS - free_slots) *
+                   KMALLOC_SLOT_SIZE, free_slots * KMALLOC_SLOT_SIZE);
+    console_printf("kmalloc: pages 0-25%% full %d, 25-50%% %d, 50-75%% %d, "
+                   "75-100%% %d\n", occupancy[0], occupancy[1], occupancy[2],
+                   occupancy[3]);
+    // Free space outside the largest gap of its page can only serve requests
+    // smaller than that gap
+    if (free_slots) {
+        console_printf("kmalloc: %d%% of free space fragmented\n",
+                       100 - 100 * gap_slots / free_slots);
+    }
+
+    kmalloc_stats_print();
+}
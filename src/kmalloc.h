@@ -11,10 +11,11 @@ See the file LICENSE for details.
  * @brief   Kernel allocation of the parameter requested size of memory
  * @details Iterates through a linked list of pages for a large enough gap of
  *          contiguous free slots of fixed size. If no page for kmalloc has a
- *          large enough gap, a new gap is asked from memory.
+ *          large enough gap, a new gap is asked from memory. Requests too
+ *          large for the slots of one page are served by vmalloc.
  *
  * @param   size The size in bytes of the chunk of memory requested from
- *          kmalloc, not to exceed 3632
+ *          kmalloc
  * @return  A pointer to the allocated memory that needs to be kfree()'d to be
  *          released.
  */
@@ -30,4 +31,12 @@ void *kmalloc(unsigned int size);
  */
 void kfree(void* to_free);
 
+/**
+ * @brief   Print the state of the kmalloc heap
+ * @details Prints how full the kmalloc pages are and how fragmented their
+ *          free space is, followed by the allocation statistics of
+ *          kmalloc_stats.c.
+ */
+void kmalloc_report();
+
 #endif
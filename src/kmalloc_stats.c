@@ -0,0 +1,265 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "kmalloc_stats.h"
+#include "console.h"
+
+#ifdef NUNYA_KMALLOC_STATS
+
+#include "clock.h"
+#include "interrupt.h"
+#include "vmalloc.h"
+
+// Live allocations are kept in an open addressing hash table keyed by address
+#define KMALLOC_STATS_BITS      11
+#define KMALLOC_STATS_RECORDS   (1 << KMALLOC_STATS_BITS)
+
+// Size classes are powers of two from 8 bytes up to a page; the last class
+// holds the requests passed on to vmalloc
+#define KMALLOC_STATS_CLASSES   11
+
+#define KMALLOC_STATS_TOP       8
+#define KMALLOC_STATS_LEAK_AGE  30      // seconds
+
+struct kmalloc_record {
+    void *ptr;              // 0 for an empty slot
+    void *caller;
+    uint32_t size;
+    uint32_t seconds;       // when it was allocated
+};
+
+struct kmalloc_class {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t live;
+    uint32_t live_bytes;
+};
+
+// The live allocations of one call site, gathered when printing
+struct kmalloc_site {
+    void *caller;
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t old_count;     // live for over KMALLOC_STATS_LEAK_AGE
+    uint32_t old_bytes;
+};
+
+static struct kmalloc_record records[KMALLOC_STATS_RECORDS];
+static struct kmalloc_class classes[KMALLOC_STATS_CLASSES];
+
+static uint32_t live_bytes = 0;
+static uint32_t peak_bytes = 0;
+static uint32_t untracked = 0;     // allocations missed with the table full
+
+static uint32_t kmalloc_stats_hash(void *ptr) {
+    return ((uint32_t)ptr * 2654435761u) >> (32 - KMALLOC_STATS_BITS);
+}
+
+static uint32_t kmalloc_stats_class(uint32_t size) {
+    uint32_t c = 0;
+    uint32_t limit = 8;
+    while (size > limit && c < KMALLOC_STATS_CLASSES - 1) {
+        limit *= 2;
+        c++;
+    }
+    return c;
+}
+
+void kmalloc_stats_alloc(void *ptr, uint32_t size, void *caller) {
+    if (!ptr) {
+        return;
+    }
+
+    unsigned flags = interrupt_save();
+
+    struct kmalloc_class *c = &classes[kmalloc_stats_class(size)];
+    c->allocs++;
+    c->live++;
+    c->live_bytes += size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes) {
+        peak_bytes = live_bytes;
+    }
+
+    uint32_t i = kmalloc_stats_hash(ptr);
+    uint32_t probes;
+    for (probes = 0; probes < KMALLOC_STATS_RECORDS; probes++) {
+        struct kmalloc_record *r = &records[i];
+        if (!r->ptr) {
+            r->ptr = ptr;
+            r->caller = caller;
+            r->size = size;
+            r->seconds = clock_read().seconds;
+            break;
+        }
+        i = (i + 1) % KMALLOC_STATS_RECORDS;
+    }
+    if (probes == KMALLOC_STATS_RECORDS) {
+        untracked++;
+    }
+
+    interrupt_restore(flags);
+}
+
+void kmalloc_stats_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    unsigned flags = interrupt_save();
+
+    uint32_t i = kmalloc_stats_hash(ptr);
+    uint32_t probes;
+    for (probes = 0; probes < KMALLOC_STATS_RECORDS; probes++) {
+        if (!records[i].ptr) {
+            // Allocated while the table was full
+            interrupt_restore(flags);
+            return;
+        }
+        if (records[i].ptr == ptr) {
+            break;
+        }
+        i = (i + 1) % KMALLOC_STATS_RECORDS;
+    }
+    if (probes == KMALLOC_STATS_RECORDS) {
+        interrupt_restore(flags);
+        return;
+    }
+
+    struct kmalloc_class *c = &classes[kmalloc_stats_class(records[i].size)];
+    c->frees++;
+    c->live--;
+    c->live_bytes -= records[i].size;
+    live_bytes -= records[i].size;
+
+    // Shift back the records that probed past this slot, so that lookups
+    // never stop early at the hole
+    uint32_t hole = i;
+    records[hole].ptr = 0;
+    for (i = (hole + 1) % KMALLOC_STATS_RECORDS; records[i].ptr;
+         i = (i + 1) % KMALLOC_STATS_RECORDS) {
+        uint32_t home = kmalloc_stats_hash(records[i].ptr);
+        // Move the record unless its home lies cyclically in (hole, i]
+        if ((i > hole && (home <= hole || home > i)) ||
+            (i < hole && (home <= hole && home > i))) {
+            records[hole] = records[i];
+            records[i].ptr = 0;
+            hole = i;
+        }
+    }
+
+    interrupt_restore(flags);
+}
+
+// Print the KMALLOC_STATS_TOP sites with the most bytes, old ones only if
+// old is set
+static void kmalloc_stats_print_top(struct kmalloc_site *sites, uint32_t nsites,
+                                    int old) {
+    uint32_t i, n;
+    for (n = 0; n < KMALLOC_STATS_TOP; n++) {
+        struct kmalloc_site *best = 0;
+        for (i = 0; i < nsites; i++) {
+            uint32_t bytes = old ? sites[i].old_bytes : sites[i].bytes;
+            if (bytes && (!best ||
+                          bytes > (old ? best->old_bytes : best->bytes))) {
+                best = &sites[i];
+            }
+        }
+        if (!best) {
+            return;
+        }
+        console_printf("  %x: %d allocations, %d bytes\n", best->caller,
+                       old ? best->old_count : best->count,
+                       old ? best->old_bytes : best->bytes);
+        if (old) {
+            best->old_bytes = 0;
+        } else {
+            best->bytes = 0;
+        }
+    }
+}
+
+void kmalloc_stats_print() {
+    uint32_t i, j;
+    uint32_t now = clock_read().seconds;
+
+    console_printf("kmalloc: %d live bytes, %d at peak\n", live_bytes,
+                   peak_bytes);
+    if (untracked) {
+        console_printf("kmalloc: %d allocations not tracked, table full\n",
+                       untracked);
+    }
+
+    console_printf("size class: allocs frees live bytes\n");
+    uint32_t limit = 8;
+    for (i = 0; i < KMALLOC_STATS_CLASSES; i++, limit *= 2) {
+        struct kmalloc_class *c = &classes[i];
+        if (!c->allocs) {
+            continue;
+        }
+        if (i == KMALLOC_STATS_CLASSES - 1) {
+            console_printf("  larger:");
+        } else {
+            console_printf("  <= %d:", limit);
+        }
+        console_printf(" %d %d %d %d\n", c->allocs, c->frees, c->live,
+                       c->live_bytes);
+    }
+
+    // Gather the live allocations by call site, out of the kmalloc heap so
+    // that the report does not show up in itself
+    struct kmalloc_site *sites = vmalloc(KMALLOC_STATS_RECORDS * sizeof(*sites));
+    if (!sites) {
+        return;
+    }
+
+    uint32_t nsites = 0;
+    unsigned flags = interrupt_save();
+    for (i = 0; i < KMALLOC_STATS_RECORDS; i++) {
+        struct kmalloc_record *r = &records[i];
+        if (!r->ptr) {
+            continue;
+        }
+        for (j = 0; j < nsites && sites[j].caller != r->caller; j++) {
+        }
+        if (j == nsites) {
+            sites[j].caller = r->caller;
+            sites[j].count = sites[j].bytes = 0;
+            sites[j].old_count = sites[j].old_bytes = 0;
+            nsites++;
+        }
+        sites[j].count++;
+        sites[j].bytes += r->size;
+        if (now - r->seconds > KMALLOC_STATS_LEAK_AGE) {
+            sites[j].old_count++;
+            sites[j].old_bytes += r->size;
+        }
+    }
+    interrupt_restore(flags);
+
+    console_printf("top allocators by live bytes:\n");
+    kmalloc_stats_print_top(sites, nsites, 0);
+    console_printf("leak candidates, live for over %ds:\n",
+                   KMALLOC_STATS_LEAK_AGE);
+    kmalloc_stats_print_top(sites, nsites, 1);
+
+    vfree(sites);
+}
+
+#else
+
+void kmalloc_stats_alloc(void *ptr, uint32_t size, void *caller) {
+}
+
+void kmalloc_stats_free(void *ptr) {
+}
+
+void kmalloc_stats_print() {
+    console_printf("kmalloc: build with 'make kstats' for allocation "
+                   "statistics\n");
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef KMALLOC_STATS_H
+#define KMALLOC_STATS_H
+
+#include "kerneltypes.h"
+
+// kmalloc only records its allocations here when built with
+// NUNYA_KMALLOC_STATS, see the kstats target of the Makefile.
+
+/**
+ * @brief   Record a live allocation
+ *
+ * @param   ptr     The address returned by kmalloc
+ * @param   size    The size requested
+ * @param   caller  The return address of the kmalloc call
+ */
+void kmalloc_stats_alloc(void *ptr, uint32_t size, void *caller);
+
+/**
+ * @brief   Forget an allocation being freed
+ *
+ * @param   ptr     The address passed to kfree
+ */
+void kmalloc_stats_free(void *ptr);
+
+/**
+ * @brief   Print the allocation statistics
+ * @details Prints the allocations per size class, the call sites holding
+ *          the most live bytes, and the call sites of allocations that have
+ *          been live for long, which are likely leaks. Call sites are
+ *          printed as addresses, to be looked up in an unstripped build.
+ */
+void kmalloc_stats_print();
+
+#endif
@@ -21,6 +21,11 @@ See the file LICENSE for details.
 #include "kernelcore.h"
 #include "cmd_line.h"
 #include "disk.h"
+#include "swap.h"
+#include "cpu.h"
+#include "page_cache.h"
+#include "fpu.h"
+#include "workqueue.h"
 
 /*
 This is the C initialization point of the kernel.
@@ -35,8 +40,12 @@ int kernel_main() {
     console_printf("video: %d x %d\n", video_xres, video_yres, video_xbytes);
     console_printf("kernel: %d bytes\n", kernel_size);
 
+    cpu_init();
+    string_init();
+
     memory_init();
     interrupt_init();
+    fpu_init();
     rtc_init();
     clock_init();
     keyboard_init();
@@ -45,9 +54,13 @@ int kernel_main() {
     process_init() is a big step.  This initializes the process table, but also gives us our own process structure, private stack, and enables paging.  Now we can do complex things like wait upon events.
     */
     process_init();
+    memory_check_high();
+    workqueue_init();
 
     mouse_init();
     ata_init();
+    page_cache_init();
+    swap_init();
 
     console_printf("\nNUNYA READY:\n");
 
@@ -12,6 +12,18 @@ See the file LICENSE for details.
 #include "memorylayout.h"
 #include "kernelcore.h"
 #include "pagetable.h"
+#include "swap.h"
+#include "bitmap.h"
+#include "interrupt.h"
+#include "shrinker.h"
+
+#ifdef NUNYA_PAE
+#define MEMORY_MAX_FRAMES (1 << 24)     // 64GB
+#else
+#define MEMORY_MAX_FRAMES (1 << 20)     // 4GB
+#endif
+
+#define FIRST_HIGH_FRAME (KERNEL_DIRECT_MAP_END >> PAGE_BITS)
 
 static uint32_t *freemap = 0;
 static uint32_t freemap_bits = 0;
@@ -24,6 +36,35 @@ static uint32_t pages_total = 0;
 
 static void *alloc_memory_start = (void *)ALLOC_MEMORY_START;
 
+// End of the memory in the freemap, which is all direct mapped
+static uint32_t low_memory_end = 0;
+
+// Frames from FIRST_HIGH_FRAME up, which are not direct mapped, and are
+// handed out for user pages only. A set bit is a free frame.
+static uint32_t *highmap = 0;
+static uint32_t highmap_frames = 0;
+static uint32_t highmap_cells = 0;
+static uint32_t highmap_hint = 0;       // no free frame in cells below
+static uint32_t high_pages_free = 0;
+static uint32_t high_pages_total = 0;
+
+// Pages cleared by the idle loop, handed out first for zeroed allocations.
+// The low pool holds direct mapped pages, and the high pool frames above the
+// direct map.
+#define MEMORY_ZERO_POOL_PAGES 64
+
+struct memory_zero_pool {
+    uint32_t frames[MEMORY_ZERO_POOL_PAGES];
+    uint32_t count;
+};
+
+// One struct page per frame, from frame 0 up to the end of the highmap
+static struct page *frame_pages = 0;
+static uint32_t frame_pages_count = 0;
+
+static struct memory_zero_pool zero_pool_low;
+static struct memory_zero_pool zero_pool_high;
+
 #define CELL_BITS (8*sizeof(*freemap))
 
 // Translate between physical address and memory page number
@@ -31,15 +72,23 @@ static void addr_from_cell_num_offset(uint32_t *addr, int cell_num, int offset);
 static void cell_num_offset_from_addr(uint32_t addr, int *cell_num, int *offset);
 
 // Detect memory map; set freemap accordingly
-static void memory_detect_map();
+static int memory_detect_map();
+static void memory_apply_map();
 static int memory_is_range_type_available(int type);
+static void memory_release_high(uint32_t frame);
 
 void memory_init() {
     int i;
 
-    memory_detect_map();
+    if (!memory_detect_map()) {
+        // No e820 map, so all we know is the amount of memory above 1MB
+        low_memory_end = ALLOC_MEMORY_START + total_memory * MEGA;
+        if (low_memory_end > KERNEL_DIRECT_MAP_END) {
+            low_memory_end = KERNEL_DIRECT_MAP_END;
+        }
+    }
 
-    pages_total = (total_memory * 1024) / (PAGE_SIZE / 1024);
+    pages_total = (low_memory_end - ALLOC_MEMORY_START) / PAGE_SIZE;
     pages_free = pages_total;
     console_printf("memory: %d MB (%d KB) total\n",
                    (pages_free * PAGE_SIZE) / MEGA,
@@ -57,11 +106,30 @@ void memory_init() {
     console_printf("memory: %d bits %d bytes %d cells %d pages\n",
                    freemap_bits, freemap_bytes, freemap_cells, freemap_pages);
 
+    // The highmap follows the freemap
+    uint32_t highmap_pages = 0;
+    if (highmap_frames) {
+        highmap = (uint32_t *)((char *)freemap + freemap_pages * PAGE_SIZE);
+        highmap_cells = BITMAP_CELLS(highmap_frames);
+        highmap_pages = 1 + highmap_cells * sizeof(*highmap) / PAGE_SIZE;
+    }
+
+    // And the struct pages follow the highmap
+    frame_pages_count = highmap_frames ? FIRST_HIGH_FRAME + highmap_frames :
+                                         low_memory_end >> PAGE_BITS;
+    uint32_t frame_pages_bytes = frame_pages_count * sizeof(struct page);
+    uint32_t frame_pages_pages = (frame_pages_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    struct page *pages = (struct page *)((char *)freemap +
+                         (freemap_pages + highmap_pages) * PAGE_SIZE);
+
     memset(freemap, 0xff, freemap_bytes);
-    for (i = 0; i < freemap_pages; i++) {
+    for (i = 0; i < freemap_pages + highmap_pages + frame_pages_pages; i++) {
         memory_alloc_page(0);
     }
 
+    memset(pages, 0, frame_pages_bytes);
+    frame_pages = pages;
+
     // This is ahack that I don't understand yet.
     // vmware doesn't like the use of a particular page
     // close to 1MB, but what it is used for I don't know.
@@ -72,28 +140,108 @@ void memory_init() {
     // so block it off
     freemap[5] = 0x0;
 
+    memory_apply_map();
+
     console_printf("memory: %d MB (%d KB) available\n",
                    (pages_free * PAGE_SIZE) / MEGA,
                    (pages_free * PAGE_SIZE) / KILO);
+    if (high_pages_total) {
+        console_printf("memory: %d MB above the direct map for user pages\n",
+                       high_pages_total / (MEGA / PAGE_SIZE));
+    }
+}
+
+void memory_check_high() {
+    uint32_t bit = highmap_frames;
+    if (!highmap) {
+        return;
+    }
+    while (bit > 0 && !bitmap_test(highmap, bit - 1)) {
+        bit--;
+    }
+    if (bit == 0) {
+        return;
+    }
+    bit--;
+
+    bitmap_clear(highmap, bit);
+    high_pages_free--;
+    uint32_t frame = FIRST_HIGH_FRAME + bit;
+    uint32_t *addr = pagetable_kmap(frame);
+    addr[0] = 0x5aa55aa5;
+    addr[PAGE_SIZE / sizeof(*addr) - 1] = frame;
+    int ok = addr[0] == 0x5aa55aa5 &&
+             addr[PAGE_SIZE / sizeof(*addr) - 1] == frame;
+    pagetable_kunmap(addr);
+    memory_release_high(frame);
+
+    // frame >> 8 is the frame's address in MB
+    console_printf("memory: top frame %x at %d MB%s %s\n", frame, frame >> 8,
+                   frame >= (1 << 20) ? " (above 4GB)" : "",
+                   ok ? "works" : "does not hold data");
+}
+
+void memory_report() {
+    console_printf("memory: %d of %d direct mapped pages in use\n",
+                   pages_total - pages_free, pages_total);
+    if (high_pages_total) {
+        console_printf("memory: %d of %d high pages in use\n",
+                       high_pages_total - high_pages_free, high_pages_total);
+    }
 }
 
 uint32_t memory_pages_free() {
-    return pages_free;
+    return pages_free + high_pages_free +
+           zero_pool_low.count + zero_pool_high.count;
 }
 
 uint32_t memory_pages_total() {
-    return pages_total;
+    return pages_total + high_pages_total;
 }
 
-void *memory_alloc_page(bool zeroit) {
-    uint32_t i, j;
-    uint32_t cellmask;
-    void *pageaddr;
+uint32_t memory_direct_map_end() {
+    return low_memory_end;
+}
 
-    if (!freemap) {
-        console_printf("memory: not initialized yet!\n");
+struct page *memory_frame_page(uint32_t frame) {
+    if (!frame_pages || frame >= frame_pages_count) {
         return 0;
     }
+    return &frame_pages[frame];
+}
+
+// Hand a frame out with one reference
+static void memory_claim_frame(uint32_t frame, uint16_t flags) {
+    struct page *page = memory_frame_page(frame);
+    if (page) {
+        page->count = 1;
+        page->flags = flags;
+        page->owner = 0;
+        page->index = 0;
+    }
+}
+
+void memory_get_frame(uint32_t frame) {
+    struct page *page = memory_frame_page(frame);
+    if (page) {
+        page->count++;
+    }
+}
+
+static uint32_t memory_zero_pool_pop(struct memory_zero_pool *pool) {
+    uint32_t frame = 0;
+    unsigned flags = interrupt_save();
+    if (pool->count > 0) {
+        frame = pool->frames[--pool->count];
+    }
+    interrupt_restore(flags);
+    return frame;
+}
+
+static void *memory_alloc_low(bool zeroit) {
+    uint32_t i, j;
+    uint32_t cellmask;
+    void *pageaddr;
 
     for (i = 0; i < freemap_cells; i++) {
         if (freemap[i] == 0) {
@@ -114,15 +262,132 @@ void *memory_alloc_page(bool zeroit) {
             }
         }
     }
+    return 0;
+}
+
+static uint32_t memory_alloc_high(bool zeroit) {
+    if (!high_pages_free) {
+        return 0;
+    }
+
+    int32_t bit = bitmap_first_set(highmap + highmap_hint,
+                                   highmap_cells - highmap_hint);
+    if (bit < 0) {
+        return 0;
+    }
+    bit += highmap_hint * BITMAP_CELL_BITS;
+    highmap_hint = bit / BITMAP_CELL_BITS;
+    bitmap_clear(highmap, bit);
+    high_pages_free--;
+
+    uint32_t frame = FIRST_HIGH_FRAME + bit;
+    if (zeroit) {
+        void *addr = pagetable_kmap(frame);
+        memset(addr, 0, PAGE_SIZE);
+        pagetable_kunmap(addr);
+    }
+    return frame;
+}
 
-    console_printf("memory: WARNING: everything allocated\n");
-    halt();
+// Below the low watermark, take pages back from the caches before the free
+// pages run out altogether
+static void memory_keep_headroom() {
+    uint32_t free = memory_pages_free();
+    if (free < shrinker_watermark_low()) {
+        shrinker_shrink(shrinker_watermark_high() - free);
+    }
+}
 
+// Make room after a failed allocation, and return whether to try again.
+// Writing pages to swap sleeps, so only a process running with interrupts
+// on does it itself. Interrupt handlers, page faults and sections that
+// blocked interrupts leave it to the worker thread and fail instead.
+static int memory_reclaim(int can_sleep) {
+    if (shrinker_shrink(SHRINKER_BATCH) > 0) {
+        return 1;
+    }
+    if (can_sleep) {
+        return swap_reclaim() > 0;
+    }
+    swap_reclaim_later();
     return 0;
 }
 
-void memory_free_page(void *pageaddr) {
-    uint32_t pagenumber = (pageaddr - alloc_memory_start) >> PAGE_BITS;
+// What to do once memory_reclaim gives up. While booting there is nobody
+// to reclaim later.
+static void memory_out_of_pages(int can_sleep) {
+    if (can_sleep || !process_all) {
+        console_printf("memory: WARNING: everything allocated\n");
+        halt();
+    }
+    console_printf("memory: out of pages, reclaiming in the background\n");
+}
+
+void *memory_alloc_page(bool zeroit) {
+    if (!freemap) {
+        console_printf("memory: not initialized yet!\n");
+        return 0;
+    }
+    memory_keep_headroom();
+    int can_sleep = current && interrupt_enabled();
+
+    // When out of frames, fall back on the zeroed pages kept for later, then
+    // empty the caches, then push user pages out to swap, and try again
+    do {
+        uint32_t frame = zeroit ? memory_zero_pool_pop(&zero_pool_low) : 0;
+        if (!frame) {
+            void *pageaddr = memory_alloc_low(zeroit);
+            frame = (uint32_t)pageaddr >> PAGE_BITS;
+        }
+        if (!frame) {
+            frame = memory_zero_pool_pop(&zero_pool_low);
+        }
+        if (frame) {
+            memory_claim_frame(frame, PAGE_STATE_KERNEL);
+            return (void *)(frame << PAGE_BITS);
+        }
+    } while (memory_reclaim(can_sleep));
+
+    memory_out_of_pages(can_sleep);
+    return 0;
+}
+
+uint32_t memory_alloc_frame(bool zeroit) {
+    if (!freemap) {
+        console_printf("memory: not initialized yet!\n");
+        return 0;
+    }
+    memory_keep_headroom();
+    int can_sleep = current && interrupt_enabled();
+
+    // Prefer the frames that the kernel can not use anyway
+    do {
+        uint32_t frame = zeroit ? memory_zero_pool_pop(&zero_pool_high) : 0;
+        if (!frame) {
+            frame = memory_alloc_high(zeroit);
+        }
+        if (!frame) {
+            void *pageaddr = memory_alloc_low(zeroit);
+            frame = (uint32_t)pageaddr >> PAGE_BITS;
+        }
+        if (!frame) {
+            frame = memory_zero_pool_pop(&zero_pool_high);
+        }
+        if (!frame) {
+            frame = memory_zero_pool_pop(&zero_pool_low);
+        }
+        if (frame) {
+            memory_claim_frame(frame, 0);
+            return frame;
+        }
+    } while (memory_reclaim(can_sleep));
+
+    memory_out_of_pages(can_sleep);
+    return 0;
+}
+
+static void memory_release_low(uint32_t frame) {
+    uint32_t pagenumber = frame - ((uint32_t)alloc_memory_start >> PAGE_BITS);
     uint32_t cellnumber = pagenumber / CELL_BITS;
     uint32_t celloffset = pagenumber % CELL_BITS;
     uint32_t cellmask = (1 << celloffset);
@@ -130,6 +395,77 @@ void memory_free_page(void *pageaddr) {
     pages_free++;
 }
 
+static void memory_release_high(uint32_t frame) {
+    uint32_t bit = frame - FIRST_HIGH_FRAME;
+    bitmap_set(highmap, bit);
+    if (bit / BITMAP_CELL_BITS < highmap_hint) {
+        highmap_hint = bit / BITMAP_CELL_BITS;
+    }
+    high_pages_free++;
+}
+
+void memory_free_page(void *pageaddr) {
+    memory_free_frame((uint32_t)pageaddr >> PAGE_BITS);
+}
+
+void memory_free_frame(uint32_t frame) {
+    struct page *page = memory_frame_page(frame);
+    if (page) {
+        if (page->count > 1) {
+            // Still shared
+            page->count--;
+            return;
+        }
+        page->count = 0;
+        page->flags = 0;
+        page->owner = 0;
+    }
+
+    if (frame < FIRST_HIGH_FRAME) {
+        memory_release_low(frame);
+    } else {
+        memory_release_high(frame);
+    }
+}
+
+int memory_zero_pool_fill() {
+    struct memory_zero_pool *pool;
+    uint32_t frame = 0;
+
+    if (!freemap) {
+        return 0;
+    }
+
+    // Take a free frame for the first pool that is not full. Pools only take
+    // frames while there are plenty left, so they never cause a reclaim.
+    unsigned flags = interrupt_save();
+    if (zero_pool_low.count < MEMORY_ZERO_POOL_PAGES &&
+        pages_free > 2 * MEMORY_ZERO_POOL_PAGES) {
+        pool = &zero_pool_low;
+        frame = (uint32_t)memory_alloc_low(0) >> PAGE_BITS;
+    } else if (zero_pool_high.count < MEMORY_ZERO_POOL_PAGES &&
+               high_pages_free > 2 * MEMORY_ZERO_POOL_PAGES) {
+        pool = &zero_pool_high;
+        frame = memory_alloc_high(0);
+    }
+    interrupt_restore(flags);
+
+    if (!frame) {
+        return 0;
+    }
+
+    // Clear it with interrupts on, so a process that becomes ready does not
+    // have to wait for it
+    void *addr = pagetable_kmap(frame);
+    memset(addr, 0, PAGE_SIZE);
+    pagetable_kunmap(addr);
+
+    flags = interrupt_save();
+    pool->frames[pool->count++] = frame;
+    interrupt_restore(flags);
+    return 1;
+}
+
 static void addr_from_cell_num_offset(uint32_t *addr, int cell_num, int offset) {
     int pagenumber = cell_num * CELL_BITS + offset;
     *addr = (pagenumber << PAGE_BITS) + (uint32_t)alloc_memory_start;
@@ -142,43 +478,109 @@ static void cell_num_offset_from_addr(uint32_t addr, int *cell_num, int *offset)
     *offset = pagenumber % CELL_BITS;
 }
 
-static void memory_detect_map() {
+static uint64_t memory_range_base(struct address_range_descriptor *d) {
+    return ((uint64_t)d->base_address_high << 32) | d->base_address_low;
+}
+
+static uint64_t memory_range_end(struct address_range_descriptor *d) {
+    uint64_t length = ((uint64_t)d->length_high << 32) | d->length_low;
+    return memory_range_base(d) + length;
+}
+
+// Size the low and high memory from the e820 map, if there is one
+static int memory_detect_map() {
     int i;
+    int found = 0;
+    uint64_t high_end = 0;
+
     for (i = 0; i < mem_descriptor_arr_max_length; ++i) {
-        if ((mem_descriptor[i].length_high
-            | mem_descriptor[i].length_low) == 0) {
+        struct address_range_descriptor *d = &mem_descriptor[i];
+        if ((d->length_high | d->length_low) == 0) {
             // skip empty entries
             continue;
         }
+        found = 1;
+        if (!memory_is_range_type_available(d->address_range_type)) {
+            continue;
+        }
 
-        // modify freemap if necessary
-        int range_length = mem_descriptor[i].length_low;
-        int type = mem_descriptor[i].address_range_type;
-        if (!memory_is_range_type_available(type)) {
-            // if the range is reserved, remove all pages from freemap
-            int length = 0;
-            uint32_t range_base_addr = mem_descriptor[i].base_address_low;
+        uint64_t base = memory_range_base(d);
+        uint64_t end = memory_range_end(d);
+        if (base < KERNEL_DIRECT_MAP_END && end > ALLOC_MEMORY_START) {
+            uint32_t low_end = end > KERNEL_DIRECT_MAP_END ?
+                               KERNEL_DIRECT_MAP_END : (uint32_t)end;
+            if (low_end > low_memory_end) {
+                low_memory_end = low_end & PAGE_MASK;
+            }
+        }
+        if (end > high_end) {
+            high_end = end;
+        }
+    }
 
-            // instead of starting in the middle of a page (which may free too
-            // few pages), we move the base_addr to start from the beginning of
-            // a page
-            range_length += range_base_addr & 0x00000fff;
-            range_base_addr &= 0xfffff000;
+    uint64_t max_end = (uint64_t)MEMORY_MAX_FRAMES << PAGE_BITS;
+    if (high_end > max_end) {
+        high_end = max_end;
+    }
+    if (high_end > KERNEL_DIRECT_MAP_END) {
+        highmap_frames = (uint32_t)(high_end >> PAGE_BITS) - FIRST_HIGH_FRAME;
+    }
+
+    return found && low_memory_end;
+}
+
+// Take reserved ranges out of the freemap, and put usable ranges above the
+// direct map into the highmap
+static void memory_apply_map() {
+    int i;
+    for (i = 0; i < mem_descriptor_arr_max_length; ++i) {
+        struct address_range_descriptor *d = &mem_descriptor[i];
+        if ((d->length_high | d->length_low) == 0) {
+            // skip empty entries
+            continue;
+        }
 
-            while (length < range_length) {
-                uint32_t addr = range_base_addr + length;
+        uint64_t base = memory_range_base(d) & ~(uint64_t)(PAGE_SIZE - 1);
+        uint64_t end = memory_range_end(d);
+        uint64_t addr;
+
+        if (!memory_is_range_type_available(d->address_range_type)) {
+            // if the range is reserved, remove all its pages from freemap
+            if (base < ALLOC_MEMORY_START) {
+                base = ALLOC_MEMORY_START;
+            }
+            if (end > low_memory_end) {
+                end = low_memory_end;
+            }
+            for (addr = base; addr < end; addr += PAGE_SIZE) {
                 int cell_num = 0;
                 int page_offset = 0;
-                cell_num_offset_from_addr(addr, &cell_num, &page_offset);
+                cell_num_offset_from_addr((uint32_t)addr, &cell_num, &page_offset);
 
                 // remove from freemap
                 uint32_t cellmask = 1 << page_offset;
                 if (freemap[cell_num] & cellmask) {
                     freemap[cell_num] &= ~cellmask;
+                    pages_free--;
+                }
+            }
+        } else if (highmap) {
+            // whole usable pages above the direct map go to the highmap
+            uint64_t first = (memory_range_base(d) + PAGE_SIZE - 1) >> PAGE_BITS;
+            uint64_t last = end >> PAGE_BITS;
+            if (first < FIRST_HIGH_FRAME) {
+                first = FIRST_HIGH_FRAME;
+            }
+            if (last > FIRST_HIGH_FRAME + highmap_frames) {
+                last = FIRST_HIGH_FRAME + highmap_frames;
+            }
+            for (addr = first; addr < last; addr++) {
+                uint32_t bit = (uint32_t)addr - FIRST_HIGH_FRAME;
+                if (!bitmap_test(highmap, bit)) {
+                    bitmap_set(highmap, bit);
+                    high_pages_free++;
+                    high_pages_total++;
                 }
-
-                // check next page
-                length += PAGE_SIZE;
             }
         }
     } // for each mem_descriptor in mem_descriptor_arr
@@ -9,11 +9,69 @@ See the file LICENSE for details.
 
 #include "kerneltypes.h"
 
+/*
+ * Every frame has a struct page, which counts the references to it and
+ * records what it is used for. memory_alloc_page and memory_alloc_frame
+ * hand out frames with one reference, memory_get_frame adds one, and
+ * memory_free_page and memory_free_frame drop one, freeing the frame when
+ * the last one goes.
+ */
+#define PAGE_STATE_KERNEL   0x01    // kernel data, never paged out
+#define PAGE_STATE_USER     0x02    // anonymous page of a process
+#define PAGE_STATE_CACHE    0x04    // file data in page_cache.c
+#define PAGE_STATE_PINNED   0x08    // must stay in memory for now
+
+struct page {
+    uint16_t count;     // references to the frame, 0 when free
+    uint16_t flags;     // PAGE_STATE_ flags
+    void *owner;        // pagetable of a user page, entry of a cache page
+    uint32_t index;     // virtual page of a user page, block of a cache page
+};
+
+/*
+ * When memory runs out, the allocators empty the caches and, if the caller
+ * can sleep, push user pages out to swap. A caller that cannot, such as an
+ * interrupt handler, a page fault or a section with interrupts blocked,
+ * gets 0 while the worker thread reclaims in the background.
+ */
 void memory_init();
 void *memory_alloc_page(bool zeroit);
 void memory_free_page(void *addr);
 
+/*
+ * Frames for user pages are handled by frame number rather than address,
+ * since they may lie above the direct map, or above 4GB with NUNYA_PAE, and
+ * must then be reached through pagetable_kmap.
+ */
+uint32_t memory_alloc_frame(bool zeroit);
+void memory_free_frame(uint32_t frame);
+void memory_get_frame(uint32_t frame);
+
+/*
+ * The struct page of a frame, or 0 for a frame memory_raw.c does not
+ * manage.
+ */
+struct page *memory_frame_page(uint32_t frame);
+
+/*
+ * Zeroed allocations are served from pools of pages cleared ahead of time.
+ * memory_zero_pool_fill clears one more page for them, and returns 0 when
+ * they are full. It is meant for the idle loop.
+ */
+int memory_zero_pool_fill();
+
+/*
+ * memory_check_high writes and reads back the highest free frame above the
+ * direct map through pagetable_kmap, and prints where it is, so a PAE boot
+ * shows whether memory above 4GB is usable. It needs paging turned on.
+ * memory_report prints how many frames below and above the direct map are
+ * in use.
+ */
+void memory_check_high();
+void memory_report();
+
 uint32_t memory_pages_free();
 uint32_t memory_pages_total();
+uint32_t memory_direct_map_end();
 
 #endif
@@ -61,6 +61,26 @@ be consumed by either the kernel or user processes.
 
 #define ALLOC_MEMORY_START  0x100000
 
+/*
+Kernel space direct maps physical memory up to KERNEL_DIRECT_MAP_END
+at most. The page frames above it, including those above 4GB when
+built with NUNYA_PAE, are only used for user pages, and are reached
+by the kernel through temporary mappings in the kmap window at the
+very top of kernel space.
+*/
+
+#define KERNEL_DIRECT_MAP_END 0x70000000
+#define KERNEL_KMAP_START     0x7fe00000
+#define KERNEL_KMAP_PAGES     512
+
+/*
+Between the direct map and the kmap window, vmalloc.c hands out
+large kernel buffers, made of pages that need not be contiguous.
+*/
+
+#define KERNEL_VMALLOC_START  KERNEL_DIRECT_MAP_END
+#define KERNEL_VMALLOC_END    KERNEL_KMAP_START
+
 /*
 We choose the user-mode address space to begin at 0x80000000,
 and the user-mode stack to start at the top of memory and
@@ -69,3 +89,37 @@ grow down. Addresses below 0x80000000 are all supervisor mode.
 
 #define PROCESS_ENTRY_POINT 0x80000000
 #define PROCESS_STACK_INIT  0xfffffff0
+
+/*
+The heap starts right after the program image, and initially holds
+PROCESS_HEAP_INITIAL bytes, which also cover the uninitialized data
+that follows the image.
+
+The stack starts out small and grows down on demand, up to the maximum
+size given to process_create: PROCESS_STACK_MAX for programs started
+with sys_run, and never more than PROCESS_STACK_LIMIT, which keeps it
+clear of the video buffer. The page just below the lowest address the
+stack may reach is a guard page that is never mapped, so that overflowing
+the stack faults instead of running into the heap.
+*/
+
+#define PROCESS_HEAP_INITIAL  0x10000
+#define PROCESS_STACK_MAX     0x800000
+#define PROCESS_STACK_LIMIT   0x10000000
+
+/*
+Memory mapped files and anonymous mappings are placed in this window
+of the user-mode address space, well above the code and below the video
+buffer, which the video BIOS typically places at 0xe0000000 or higher.
+*/
+
+#define PROCESS_MMAP_START  0xa0000000
+#define PROCESS_MMAP_END    0xe0000000
+
+/*
+The page just below the mmap window holds the kernel's clock, shared
+read-only with every process so that it can read the time without a
+system call.
+*/
+
+#define PROCESS_CLOCK_PAGE  0x9ffff000
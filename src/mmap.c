@@ -0,0 +1,390 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "mmap.h"
+#include "vm_area.h"
+#include "page_cache.h"
+#include "swap.h"
+#include "pagetable.h"
+#include "memorylayout.h"
+#include "memory_raw.h"
+#include "kmalloc.h"
+#include "fs.h"
+#include "iso.h"
+#include "ata.h"
+#include "console.h"
+#include "clock_page.h"
+
+#define PAGE_ROUND_UP(x) (((x) + PAGE_SIZE - 1) & PAGE_MASK)
+
+static uint32_t mmap_block_for_page(struct vm_area *a, uint32_t page) {
+    return a->extent + (a->offset + (page - a->start)) / ATAPI_BLOCKSIZE;
+}
+
+// Unmap the pages of an area in [start, start + length), giving file pages
+// back to the page cache and anonymous frames back to the allocator
+static void mmap_release_pages(struct process *p, struct vm_area *a,
+                               uint32_t start, uint32_t length) {
+    uint32_t offset;
+    struct pagetable_gather g;
+
+    // p is in the kernel, so it cannot use the stale translations before
+    // they are all invalidated at the end
+    pagetable_gather_init(&g, p->pagetable);
+    for (offset = 0; offset < length; offset += PAGE_SIZE) {
+        uint32_t page = start + offset;
+        unsigned frame, slot;
+        if (!pagetable_getframe(p->pagetable, page, &frame)) {
+            if (pagetable_getswap(p->pagetable, page, &slot)) {
+                pagetable_gather_unmap(&g, page);
+                swap_free(slot);
+                p->number_of_pages_using--;
+            }
+            continue;
+        }
+        pagetable_gather_unmap(&g, page);
+        if (a->type == VM_AREA_FILE) {
+            page_cache_put(a->ata_unit, mmap_block_for_page(a, page));
+        } else {
+            memory_free_frame(frame);
+        }
+        p->number_of_pages_using--;
+    }
+    pagetable_gather_flush(&g);
+}
+
+static struct vm_area *mmap_add_area(struct process *p, uint32_t start,
+                                     uint32_t length, int type) {
+    struct vm_area *a = vm_area_create(start, length, type);
+    if (a) {
+        vm_area_insert(&p->vm_areas, a);
+    }
+    return a;
+}
+
+int mmap_init(struct process *p, uint32_t code_size, uint32_t stack_max) {
+    p->vm_areas = 0;
+
+    uint32_t code_end = PROCESS_ENTRY_POINT + PAGE_ROUND_UP(code_size);
+    if (code_size && !mmap_add_area(p, PROCESS_ENTRY_POINT,
+                                    code_end - PROCESS_ENTRY_POINT,
+                                    VM_AREA_CODE)) {
+        return 0;
+    }
+
+    p->heap = mmap_add_area(p, code_end, PROCESS_HEAP_INITIAL, VM_AREA_HEAP);
+    if (!p->heap) {
+        return 0;
+    }
+    p->brk = code_end + PROCESS_HEAP_INITIAL;
+
+    p->fault_start = 0;
+    p->fault_end = 0;
+    p->fault_window = 1;
+
+    if (!mmap_add_area(p, PROCESS_CLOCK_PAGE, PAGE_SIZE, VM_AREA_SHARED) ||
+        !clock_page_map(p->pagetable)) {
+        return 0;
+    }
+
+    p->stack = 0;
+    p->stack_limit = 0;
+    if (stack_max == 0) {
+        return 1;
+    }
+    if (stack_max > PROCESS_STACK_LIMIT) {
+        stack_max = PROCESS_STACK_LIMIT;
+    }
+    stack_max = PAGE_ROUND_UP(stack_max);
+
+    // The stack area ends at the very top of the address space, and only
+    // covers the part of the stack grown so far
+    uint32_t length = MMAP_STACK_GROW * PAGE_SIZE;
+    if (length > stack_max) {
+        length = stack_max;
+    }
+    p->stack = mmap_add_area(p, -length, length, VM_AREA_STACK);
+    if (!p->stack) {
+        return 0;
+    }
+    p->stack_limit = -stack_max;
+    return 1;
+}
+
+uint32_t mmap_file(struct process *p, uint32_t fd, uint32_t offset,
+                   uint32_t length) {
+    struct fs_agnostic_file *f = fs_file_for_read(fd);
+    if (!f || f->ata_type != ISO) {
+        return 0;
+    }
+    struct iso_file *file = (struct iso_file *)f->filep;
+
+    if (offset % PAGE_SIZE || offset >= file->data_length || length == 0) {
+        return 0;
+    }
+    if (length > file->data_length - offset) {
+        length = file->data_length - offset;
+    }
+    length = PAGE_ROUND_UP(length);
+
+    uint32_t start = vm_area_find_gap(p->vm_areas, PROCESS_MMAP_START,
+                                      PROCESS_MMAP_END, length);
+    if (!start) {
+        return 0;
+    }
+
+    struct vm_area *a = mmap_add_area(p, start, length, VM_AREA_FILE);
+    if (!a) {
+        return 0;
+    }
+    a->ata_unit = file->ata_unit;
+    a->extent = file->extent_offset;
+    a->offset = offset;
+    a->data_length = file->data_length;
+
+    return start;
+}
+
+uint32_t mmap_anon(struct process *p, uint32_t length) {
+    if (length == 0 || length > PROCESS_MMAP_END - PROCESS_MMAP_START) {
+        return 0;
+    }
+    length = PAGE_ROUND_UP(length);
+
+    uint32_t start = vm_area_find_gap(p->vm_areas, PROCESS_MMAP_START,
+                                      PROCESS_MMAP_END, length);
+    if (!start || !mmap_add_area(p, start, length, VM_AREA_ANON)) {
+        return 0;
+    }
+    return start;
+}
+
+int32_t mmap_unmap(struct process *p, uint32_t addr) {
+    struct vm_area *a = vm_area_find(p->vm_areas, addr);
+    if (!a || a->start != addr ||
+        (a->type != VM_AREA_FILE && a->type != VM_AREA_ANON)) {
+        return -1;
+    }
+    mmap_release_pages(p, a, a->start, a->length);
+    vm_area_remove(&p->vm_areas, a);
+    kfree(a);
+    return 0;
+}
+
+uint32_t mmap_brk(struct process *p, uint32_t addr) {
+    struct vm_area *heap = p->heap;
+    if (addr == 0 || addr < heap->start + PROCESS_HEAP_INITIAL) {
+        return p->brk;
+    }
+
+    uint32_t old_end = heap->start + heap->length;
+    uint32_t new_end = PAGE_ROUND_UP(addr);
+    if (new_end < addr) {
+        return p->brk;
+    }
+
+    if (new_end > old_end) {
+        if (vm_area_find_overlap(p->vm_areas, old_end, new_end - old_end)) {
+            return p->brk;
+        }
+        // Leave the guard page below the stack alone
+        if (p->stack && new_end > p->stack_limit - PAGE_SIZE) {
+            return p->brk;
+        }
+    } else if (new_end < old_end) {
+        mmap_release_pages(p, heap, new_end, old_end - new_end);
+    }
+    heap->length = new_end - heap->start;
+    p->brk = addr;
+    return p->brk;
+}
+
+static int mmap_fault_file(struct process *p, struct vm_area *a, uint32_t page) {
+    uint32_t file_offset = a->offset + (page - a->start);
+    uint32_t valid = a->data_length - file_offset;
+    if (valid > PAGE_SIZE) {
+        valid = PAGE_SIZE;
+    }
+
+    void *frame = page_cache_get(a->ata_unit, mmap_block_for_page(a, page), valid);
+    if (!frame) {
+        return -1;
+    }
+
+    if (!pagetable_map(p->pagetable, page, (unsigned)frame,
+                       PAGE_FLAG_USER | PAGE_FLAG_READONLY)) {
+        page_cache_put(a->ata_unit, mmap_block_for_page(a, page));
+        return -1;
+    }
+    return 1;
+}
+
+static uint32_t mmap_quota_left(struct process *p) {
+    int left = p->permissions->max_number_of_pages - p->number_of_pages_using;
+    return left > 0 ? left : 0;
+}
+
+// Map the anonymous pages of a cluster around page, whose size adapts to
+// how sequential the faults of the process are
+static int mmap_fault_anon(struct process *p, struct vm_area *a, uint32_t page) {
+    if (page == p->fault_end || page + PAGE_SIZE == p->fault_start) {
+        if (p->fault_window < MMAP_FAULT_AROUND_MAX) {
+            p->fault_window *= 2;
+        }
+    } else {
+        p->fault_window = 1;
+    }
+
+    uint32_t window = p->fault_window;
+    if (window > mmap_quota_left(p)) {
+        window = 1;
+    }
+
+    // Align the cluster to its size, and keep it inside the area
+    uint32_t aligned = page & ~(window * PAGE_SIZE - 1);
+    uint32_t start = aligned < a->start ? a->start : aligned;
+    uint32_t npages = window - (start - aligned) / PAGE_SIZE;
+    uint32_t area_left = (a->length - (start - a->start)) / PAGE_SIZE;
+    if (npages > area_left) {
+        npages = area_left;
+    }
+
+    uint32_t mapped = pagetable_populate(p->pagetable, start, npages,
+                                         mmap_quota_left(p),
+                                         PAGE_FLAG_USER | PAGE_FLAG_READWRITE |
+                                         PAGE_FLAG_CLEAR);
+    if (mapped == 0) {
+        return -1;
+    }
+    p->number_of_pages_using += mapped;
+    p->fault_start = start;
+    p->fault_end = start + npages * PAGE_SIZE;
+    return 1;
+}
+
+// Extend the stack area down to the chunk holding page, and map the pages of
+// that chunk which the area did not cover yet
+static int mmap_grow_stack(struct process *p, uint32_t page) {
+    struct vm_area *a = p->stack;
+    uint32_t old_start = a->start;
+    uint32_t start = page & ~(MMAP_STACK_GROW * PAGE_SIZE - 1);
+    if (start < p->stack_limit) {
+        start = p->stack_limit;
+    }
+
+    // The tree is keyed on the start of the areas
+    vm_area_remove(&p->vm_areas, a);
+    a->length += a->start - start;
+    a->start = start;
+    vm_area_insert(&p->vm_areas, a);
+
+    uint32_t npages = (old_start - start) / PAGE_SIZE;
+    if (npages > MMAP_STACK_GROW) {
+        npages = MMAP_STACK_GROW;
+    }
+    // Without the quota for the whole chunk, just map the faulting page
+    if (npages > mmap_quota_left(p)) {
+        return mmap_fault_anon(p, a, page);
+    }
+
+    uint32_t mapped = pagetable_populate(p->pagetable, start, npages, npages,
+                                         PAGE_FLAG_USER | PAGE_FLAG_READWRITE |
+                                         PAGE_FLAG_CLEAR);
+    if (mapped == 0) {
+        return -1;
+    }
+    p->number_of_pages_using += mapped;
+    p->fault_start = start;
+    p->fault_end = start + npages * PAGE_SIZE;
+    return 1;
+}
+
+int mmap_handle_fault(struct process *p, uint32_t vaddr) {
+    uint32_t page = vaddr & PAGE_MASK;
+    struct vm_area *a = vm_area_find(p->vm_areas, vaddr);
+    if (a && a->type == VM_AREA_SHARED) {
+        // Always mapped, so this was a write
+        return 0;
+    }
+    if (!a) {
+        if (!p->stack || vaddr >= p->stack->start ||
+            vaddr < p->stack_limit - PAGE_SIZE) {
+            return 0;
+        }
+        if (vaddr < p->stack_limit) {
+            console_printf("process %d: stack overflow at %x\n", p->pid, vaddr);
+            return 0;
+        }
+        if (mmap_quota_left(p) == 0) {
+            return -1;
+        }
+        return mmap_grow_stack(p, page);
+    }
+
+    if (mmap_quota_left(p) == 0) {
+        return -1;
+    }
+
+    if (a->type == VM_AREA_FILE) {
+        if (mmap_fault_file(p, a, page) < 0) {
+            return -1;
+        }
+        p->number_of_pages_using++;
+        return 1;
+    }
+    return mmap_fault_anon(p, a, page);
+}
+
+int32_t mmap_prefault(struct process *p, uint32_t addr, uint32_t length) {
+    uint32_t page = addr & PAGE_MASK;
+    uint32_t npages = (addr - page + length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    while (npages > 0) {
+        struct vm_area *a = vm_area_find(p->vm_areas, page);
+        if (!a) {
+            return -1;
+        }
+        uint32_t n = (a->length - (page - a->start)) / PAGE_SIZE;
+        if (n > npages) {
+            n = npages;
+        }
+
+        if (a->type == VM_AREA_FILE) {
+            uint32_t i;
+            for (i = 0; i < n && mmap_quota_left(p) > 0; i++) {
+                unsigned frame;
+                uint32_t vaddr = page + i * PAGE_SIZE;
+                if (!pagetable_getframe(p->pagetable, vaddr, &frame) &&
+                    mmap_fault_file(p, a, vaddr) > 0) {
+                    p->number_of_pages_using++;
+                }
+            }
+        } else {
+            p->number_of_pages_using +=
+                pagetable_populate(p->pagetable, page, n, mmap_quota_left(p),
+                                   PAGE_FLAG_USER | PAGE_FLAG_READWRITE |
+                                   PAGE_FLAG_CLEAR);
+        }
+
+        page += n * PAGE_SIZE;
+        npages -= n;
+    }
+    return 0;
+}
+
+void mmap_cleanup(struct process *p) {
+    struct vm_area *a;
+    while ((a = vm_area_first(p->vm_areas))) {
+        // Anonymous frames are freed along with the pagetable
+        if (a->type == VM_AREA_FILE) {
+            mmap_release_pages(p, a, a->start, a->length);
+        }
+        vm_area_remove(&p->vm_areas, a);
+        kfree(a);
+    }
+    p->heap = 0;
+    p->stack = 0;
+}
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "kerneltypes.h"
+#include "process.h"
+
+// Largest cluster of pages mapped by a single anonymous page fault
+#define MMAP_FAULT_AROUND_MAX 16
+
+// Pages by which the stack area grows when a fault runs past its bottom
+#define MMAP_STACK_GROW 4
+
+/**
+ * @brief   Set up the initial address space areas of a new process
+ * @details Creates the code area at PROCESS_ENTRY_POINT, the heap area right
+ *          after it, holding PROCESS_HEAP_INITIAL bytes for the program's
+ *          uninitialized data, the clock page at PROCESS_CLOCK_PAGE, and the
+ *          stack area, MMAP_STACK_GROW pages
+ *          at the top of the address space. Only addresses inside an area
+ *          may be faulted in, except for the stack, which grows down as far
+ *          as stack_max bytes below the top, leaving an unmapped guard page
+ *          under its lowest possible address.
+ *
+ * @param   p           The new process
+ * @param   code_size   Size of the program image in bytes
+ * @param   stack_max   Largest size of the stack in bytes, clipped to
+ *                      PROCESS_STACK_LIMIT, or 0 for no user stack at all
+ * @return  1 on success, 0 if the areas could not be allocated
+ */
+int mmap_init(struct process *p, uint32_t code_size, uint32_t stack_max);
+
+/**
+ * @brief   Map a read-only range of an open file into a process
+ * @details Reserves a range of the process' address space between
+ *          PROCESS_MMAP_START and PROCESS_MMAP_END for the file. No data is
+ *          read up front: each page is filled on its first access by the page
+ *          fault handler, straight from the page cache, so processes mapping
+ *          the same file share the same physical pages.
+ *
+ * @param   p       The process to map the file into
+ * @param   fd      A file descriptor of p opened for reading
+ * @param   offset  Offset into the file, must be a multiple of PAGE_SIZE
+ * @param   length  Number of bytes to map, clipped to the end of the file
+ * @return  The virtual address of the mapping, or 0 on failure
+ */
+uint32_t mmap_file(struct process *p, uint32_t fd, uint32_t offset,
+                   uint32_t length);
+
+/**
+ * @brief   Reserve a range of zero-filled memory in a process
+ * @details Reserves a range between PROCESS_MMAP_START and PROCESS_MMAP_END.
+ *          Pages are only allocated, and counted toward the process' memory
+ *          allocation, when first touched, so large reservations are cheap.
+ *
+ * @param   p       The process to reserve memory in
+ * @param   length  Number of bytes to reserve, rounded up to PAGE_SIZE
+ * @return  The virtual address of the mapping, or 0 on failure
+ */
+uint32_t mmap_anon(struct process *p, uint32_t length);
+
+/**
+ * @brief   Remove a mapping from a process
+ * @details Unmaps every page of the mapping starting at addr, releasing the
+ *          page cache references of a file mapping and the frames of an
+ *          anonymous one.
+ *
+ * @param   p       The process owning the mapping
+ * @param   addr    The address returned when the mapping was created
+ * @return  0 on success, -1 if there is no mapping at addr
+ */
+int32_t mmap_unmap(struct process *p, uint32_t addr);
+
+/**
+ * @brief   Move the end of the heap of a process
+ * @details Growing the heap only reserves address space; shrinking it
+ *          releases the pages above the new break. The break can not go
+ *          below its initial value nor run into another area or the range
+ *          reserved for the stack.
+ *
+ * @param   p       The process whose heap is resized
+ * @param   addr    The new break, or 0 to query the current one
+ * @return  The break after the call, unchanged if addr was not acceptable
+ */
+uint32_t mmap_brk(struct process *p, uint32_t addr);
+
+/**
+ * @brief   Resolve a page fault against the areas of a process
+ * @details Maps zeroed frames into anonymous, code, heap and stack areas, and
+ *          the matching page cache page read-only into file mappings. A fault
+ *          right next to the pages mapped by the previous one doubles the
+ *          number of pages mapped around the faulting address, up to
+ *          MMAP_FAULT_AROUND_MAX, as long as the process has quota for them;
+ *          any other fault maps a single page again. A fault below the stack
+ *          area but within its maximum size grows the area down to the
+ *          MMAP_STACK_GROW page boundary below vaddr and maps that whole
+ *          chunk at once; a fault in the guard page is a stack overflow.
+ *
+ * @param   p       The faulting process
+ * @param   vaddr   The faulting virtual address
+ * @return  1 if the page was mapped, 0 if vaddr is not inside any area,
+ *          and -1 if it is but the page could not be mapped
+ */
+int mmap_handle_fault(struct process *p, uint32_t vaddr);
+
+/**
+ * @brief   Map every page of a range ahead of its use
+ * @details Anonymous pages are allocated and file pages read in as if each
+ *          had been touched, up to the process' memory allocation, so that
+ *          initializing a large buffer does not take a fault per page.
+ *
+ * @param   p       The process
+ * @param   addr    Start of the range
+ * @param   length  Length of the range in bytes
+ * @return  0 on success, -1 if part of the range is outside every area
+ */
+int32_t mmap_prefault(struct process *p, uint32_t addr, uint32_t length);
+
+/**
+ * @brief   Remove all areas of a process
+ * @details Used when a process exits, before its pagetable is deleted, which
+ *          frees the frames of the anonymous areas.
+ *
+ * @param   p   The process whose areas are removed
+ */
+void mmap_cleanup(struct process *p);
+
+#endif
@@ -7,6 +7,14 @@ See the file LICENSE for details.
 #include "console.h"
 #include "pagetable.h"
 #include "process.h"
+#include "string.h"
+#include "cpu.h"
+#include "vmalloc.h"
+
+// The string benchmark runs on kernel space buffers, so that every variant
+// can be used on them
+#define STRING_BENCH_MAX        (1 << 20)
+#define STRING_BENCH_VOLUME     (4 << 20)   // bytes moved per measurement
 
 void walk_memory() {
     // allocate some new memory
@@ -20,12 +28,72 @@ void walk_memory() {
     while (1) {
         uint32_t test = *(uint32_t *)vaddr;
 
-        uint32_t paddr;
-        pagetable_getmap(current->pagetable, vaddr, &paddr);
+        uint32_t frame;
+        pagetable_getframe(current->pagetable, vaddr, &frame);
         ++test;
-        console_printf("[sl] changed memory at %x (physical %x)\n",
-            vaddr, paddr);
+        console_printf("[sl] changed memory at %x (frame %x)\n",
+            vaddr, frame);
 
         vaddr += PAGE_SIZE;
     }
 }
+
+static const char *string_bench_names[] = {"bytes", "words", "sse2", "ermsb"};
+
+// Cycles per KB moved by memcpy (copy) or memset, at the given size
+static uint32_t string_bench_run(char *dst, const char *src, int copy,
+                                 uint32_t size) {
+    uint32_t calls = STRING_BENCH_VOLUME / size;
+    uint32_t i;
+
+    uint64_t start = cpu_read_tsc();
+    for (i = 0; i < calls; i++) {
+        if (copy) {
+            memcpy(dst, src, size);
+        } else {
+            memset(dst, i, size);
+        }
+    }
+    uint32_t cycles = (uint32_t)(cpu_read_tsc() - start);
+    return cycles / (STRING_BENCH_VOLUME / KILO);
+}
+
+void string_benchmark() {
+    int copy, variant;
+    uint32_t size;
+
+    if (!cpu_has(CPU_FEATURE_TSC)) {
+        console_printf("string_bench: needs a time stamp counter\n");
+        return;
+    }
+
+    char *src = vmalloc(STRING_BENCH_MAX);
+    char *dst = vmalloc(STRING_BENCH_MAX);
+    if (!src || !dst) {
+        console_printf("string_bench: cannot allocate buffers\n");
+        vfree(src);
+        vfree(dst);
+        return;
+    }
+    memset(src, 0x5a, STRING_BENCH_MAX);
+
+    for (copy = 1; copy >= 0; copy--) {
+        console_printf("%s, cycles per KB:\n", copy ? "memcpy" : "memset");
+        for (size = 8; size <= STRING_BENCH_MAX; size *= 2) {
+            console_printf("  %d bytes:", size);
+            for (variant = STRING_VARIANT_BYTES;
+                 variant <= STRING_VARIANT_ERMSB; variant++) {
+                if (string_select(variant)) {
+                    console_printf(" %s %d", string_bench_names[variant],
+                                   string_bench_run(dst, src, copy, size));
+                }
+            }
+            console_printf("\n");
+        }
+    }
+
+    // Back to the best variant
+    string_init();
+    vfree(src);
+    vfree(dst);
+}
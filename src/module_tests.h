@@ -11,3 +11,10 @@ See the file LICENSE for details.
  *          finish allocating all available memory frames.
  */
 void walk_memory();
+
+/**
+ * @brief   Measure the memcpy and memset variants of string.c
+ * @details Times each variant the processor supports on sizes from 8 bytes
+ *          to 1MB, and prints the cycles spent per KB.
+ */
+void string_benchmark();
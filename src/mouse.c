@@ -12,13 +12,23 @@
 #include "graphics.h"
 #include "console.h"
 #include "window_manager.h"
-#include "memory_raw.h"
+#include "vmalloc.h"
+#include "string.h"
+#include "workqueue.h"
 
 static uint8_t mouse_cycle = 0;
 static uint8_t mouse_byte[3];
 struct graphics_color mouse_fg_color = {0, 255, 0};
 static bool mouse_enabled = 1;
 
+// Where the packets put the pointer. The interrupt only updates these; the
+// worker moves the drawn pointer (mouse_x, mouse_y) there.
+static int target_x;
+static int target_y;
+
+static void mouse_redraw(void *arg);
+static struct work mouse_work = WORK_INIT(mouse_redraw, 0);
+
 void set_mouse_fg_color(uint8_t r, uint8_t g, uint8_t b) {
     mouse_fg_color.r = r;
     mouse_fg_color.g = g;
@@ -76,25 +86,46 @@ int mouse_map() {
     byte2 = x_sign ? (byte2 | 0xFFFFFF00) : byte2;
     byte3 = y_sign ? (byte3 | 0xFFFFFF00) : byte3;
 
-    old_mouse_x = mouse_x;
-    old_mouse_y = mouse_y;
+    int old_x = target_x;
+    int old_y = target_y;
 
-    mouse_x += byte2;
+    target_x += byte2;
     // negative values are down with mouse offsets (opposite of graphics
-    mouse_y -= byte3;
+    target_y -= byte3;
 
     // keep mouse coords in bounds
-    mouse_x = mouse_x < 0 ? 0 : mouse_x;
-    mouse_x = mouse_x > graphics_width() - 1 ? graphics_width() - 1 : mouse_x;
-    mouse_y = mouse_y < 0 ? 0 : mouse_y;
-    mouse_y = mouse_y > graphics_height() - 1 ? graphics_height() - 1 : mouse_y;
+    target_x = target_x < 0 ? 0 : target_x;
+    target_x = target_x > graphics_width() - 1 ? graphics_width() - 1 : target_x;
+    target_y = target_y < 0 ? 0 : target_y;
+    target_y = target_y > graphics_height() - 1 ? graphics_height() - 1 : target_y;
 
-    if (old_mouse_x != mouse_x || old_mouse_y != mouse_y) {
+    if (old_x != target_x || old_y != target_y) {
         return 1;
     }
     return 0;
 }
 
+// Runs in the worker thread; several packets may have come in since the
+// last redraw
+static void mouse_redraw(void *arg) {
+    interrupt_block();
+    int x = target_x;
+    int y = target_y;
+    interrupt_unblock();
+
+    if (x == mouse_x && y == mouse_y) {
+        return;
+    }
+    old_mouse_x = mouse_x;
+    old_mouse_y = mouse_y;
+    mouse_x = x;
+    mouse_y = y;
+    graphics_mouse();
+    //TODO: Filter out mouse events that happen
+    // outside the current window
+    send_event_mouse_move();
+}
+
 int mouse_request_packet() {
     // command to request a single packet
     ps2_command_write(0xEB , PS2_COMMAND_REGISTER);
@@ -126,10 +157,7 @@ void mouse_interrupt() {
             mouse_cycle++;
             mouse_cycle = 0;
             if (mouse_enabled && mouse_map()) {
-                graphics_mouse();
-                //TODO: Filter out mouse events that happen
-                // outside the current window
-                send_event_mouse_move();
+                work_schedule(&mouse_work);
             }
             break;
     }
@@ -137,10 +165,9 @@ void mouse_interrupt() {
 }
 
 void mouse_init() {
-    // We need to claim two pages, but we can only claim one at a time from emmory.
-    // Since this is in startup, we can call two in a row and know that it will be contiguous
-    mouse_draw_buffer = memory_alloc_page(1);
-    memory_alloc_page(1);
+    // The saved area under the cursor takes two pages
+    mouse_draw_buffer = vmalloc(2 * PAGE_SIZE);
+    memset(mouse_draw_buffer, 0, 2 * PAGE_SIZE);
     // enable port 2 and interrupts for port 2 (enable IRQ12)
     outb(0xA8, PS2_COMMAND_REGISTER);
     uint8_t cont_config_byte = ps2_read_controller_config_byte();
@@ -172,6 +199,8 @@ void mouse_init() {
 
     old_mouse_x = mouse_x;
     old_mouse_y = mouse_y;
+    target_x = mouse_x;
+    target_y = mouse_y;
 
     graphics_copy_to_color_buffer(mouse_x - MOUSE_SIDE_2 + 1, mouse_y - MOUSE_SIDE_2 + 1, MOUSE_SIDE - 1, MOUSE_SIDE - 1, mouse_draw_buffer, (MOUSE_SIDE - 1) * (MOUSE_SIDE - 1));
 
@@ -0,0 +1,188 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "page_cache.h"
+#include "ata.h"
+#include "list.h"
+#include "kmalloc.h"
+#include "memory_raw.h"
+#include "string.h"
+#include "kerneltypes.h"
+#include "shrinker.h"
+#include "interrupt.h"
+
+#define PAGE_CACHE_BUCKETS 64
+
+#define BLOCKS_PER_PAGE (PAGE_SIZE / ATAPI_BLOCKSIZE)
+
+struct page_cache_entry {
+    struct list_node node;  // chain in the hash bucket
+    int ata_unit;
+    uint32_t block;         // first ATAPI block held by the page
+    void *page;             // physical page holding the data
+    int refcount;
+};
+
+static struct list page_cache_buckets[PAGE_CACHE_BUCKETS];
+
+// Number of cached pages that nobody references anymore
+static uint32_t page_cache_unused = 0;
+
+// Bucket where the next eviction scan starts
+static uint32_t page_cache_evict_hand = 0;
+
+static struct list *page_cache_bucket(int ata_unit, uint32_t block) {
+    return &page_cache_buckets[(block / BLOCKS_PER_PAGE + ata_unit) % PAGE_CACHE_BUCKETS];
+}
+
+static struct page_cache_entry *page_cache_lookup(int ata_unit, uint32_t block) {
+    struct list_node *n;
+    for (n = page_cache_bucket(ata_unit, block)->head; n; n = n->next) {
+        struct page_cache_entry *e = (struct page_cache_entry *)n;
+        if (e->ata_unit == ata_unit && e->block == block) {
+            return e;
+        }
+    }
+    return 0;
+}
+
+// Free one unreferenced page, sweeping the buckets round robin
+static int page_cache_evict_one() {
+    uint32_t i;
+    for (i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+        struct list *bucket = &page_cache_buckets[page_cache_evict_hand];
+        page_cache_evict_hand = (page_cache_evict_hand + 1) % PAGE_CACHE_BUCKETS;
+
+        struct list_node *n;
+        for (n = bucket->head; n; n = n->next) {
+            struct page_cache_entry *e = (struct page_cache_entry *)n;
+            if (e->refcount == 0) {
+                list_remove(&e->node);
+                memory_free_page(e->page);
+                kfree(e);
+                page_cache_unused--;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint32_t page_cache_count() {
+    return page_cache_unused;
+}
+
+// The pages are read-only copies of the disk, so any unreferenced one can go
+static uint32_t page_cache_scan(uint32_t nr) {
+    uint32_t freed = 0;
+    while (freed < nr) {
+        // Evict with interrupts blocked, since this may run from an
+        // allocation made inside an interrupt handler
+        unsigned flags = interrupt_save();
+        int evicted = page_cache_evict_one();
+        interrupt_restore(flags);
+        if (!evicted) {
+            break;
+        }
+        freed++;
+    }
+    return freed;
+}
+
+static struct shrinker page_cache_shrinker = {
+    .name = "page cache",
+    .count = page_cache_count,
+    .scan = page_cache_scan,
+};
+
+void page_cache_init() {
+    shrinker_register(&page_cache_shrinker);
+}
+
+// Take a reference to a cached page. Lookups and reference counts are
+// only changed with interrupts blocked, since the shrinker may evict pages
+// from an allocation made inside an interrupt handler.
+static void *page_cache_find_get(int ata_unit, uint32_t block) {
+    void *page = 0;
+    unsigned flags = interrupt_save();
+    struct page_cache_entry *e = page_cache_lookup(ata_unit, block);
+    if (e) {
+        if (e->refcount == 0) {
+            page_cache_unused--;
+        }
+        e->refcount++;
+        page = e->page;
+    }
+    interrupt_restore(flags);
+    return page;
+}
+
+void *page_cache_get(int ata_unit, uint32_t block, uint32_t length) {
+    void *cached = page_cache_find_get(ata_unit, block);
+    if (cached) {
+        return cached;
+    }
+
+    if (length == 0 || length > PAGE_SIZE) {
+        return 0;
+    }
+
+    // Read the blocks straight into the page that will be mapped
+    uint32_t nblocks = (length + ATAPI_BLOCKSIZE - 1) / ATAPI_BLOCKSIZE;
+    void *page = memory_alloc_page(0);
+    if (!page) {
+        return 0;
+    }
+    if (!atapi_read(ata_unit, page, nblocks, block)) {
+        memory_free_page(page);
+        return 0;
+    }
+    if (length < PAGE_SIZE) {
+        memset(page + length, 0, PAGE_SIZE - length);
+    }
+
+    struct page_cache_entry *e = kmalloc(sizeof(*e));
+    if (!e) {
+        memory_free_page(page);
+        return 0;
+    }
+    e->ata_unit = ata_unit;
+    e->block = block;
+    e->page = page;
+    e->refcount = 1;
+
+    struct page *meta = memory_frame_page((uint32_t)page >> PAGE_BITS);
+    meta->flags = PAGE_STATE_CACHE;
+    meta->owner = e;
+    meta->index = block;
+
+    // Someone else may have filled the same page while we slept on the disk
+    unsigned flags = interrupt_save();
+    cached = page_cache_find_get(ata_unit, block);
+    if (!cached) {
+        list_push_head(page_cache_bucket(ata_unit, block), &e->node);
+    }
+    interrupt_restore(flags);
+
+    if (cached) {
+        kfree(e);
+        memory_free_page(page);
+        return cached;
+    }
+    return page;
+}
+
+void page_cache_put(int ata_unit, uint32_t block) {
+    unsigned flags = interrupt_save();
+    struct page_cache_entry *e = page_cache_lookup(ata_unit, block);
+    if (e && e->refcount > 0) {
+        e->refcount--;
+        if (e->refcount == 0) {
+            page_cache_unused++;
+        }
+    }
+    interrupt_restore(flags);
+}
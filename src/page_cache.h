@@ -0,0 +1,47 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "kerneltypes.h"
+
+/**
+ * @brief   Register the page cache as a reclaimable cache
+ * @details Pages nobody references stay cached until free memory runs low,
+ *          at which point shrinker.c asks the cache to release them.
+ */
+void page_cache_init();
+
+/**
+ * @brief   Get a cached page of data from an ATAPI unit
+ * @details Looks up the page that starts at the given ATAPI block. If the page
+ *          is not cached yet, a new physical page is allocated and filled
+ *          straight from the device, so that the page can be mapped into
+ *          user processes without further copies. Bytes past length are
+ *          zeroed. Each successful call takes a reference on the page that
+ *          must be released with page_cache_put.
+ *
+ * @param   ata_unit    The ATAPI unit the data lives on
+ * @param   block       The first ATAPI block of the page
+ * @param   length      The number of valid bytes in the page, at most
+ *                      PAGE_SIZE
+ * @return  The physical address of the page, or 0 on failure
+ */
+void *page_cache_get(int ata_unit, uint32_t block, uint32_t length);
+
+/**
+ * @brief   Release a reference on a cached page
+ * @details Drops a reference taken by page_cache_get. Pages without references
+ *          stay cached for later users, until memory runs low and the
+ *          shrinker evicts them.
+ *
+ * @param   ata_unit    The ATAPI unit the data lives on
+ * @param   block       The first ATAPI block of the page
+ */
+void page_cache_put(int ata_unit, uint32_t block);
+
+#endif
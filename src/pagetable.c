@@ -11,9 +11,46 @@ See the file LICENSE for details.
 #include "kernelcore.h"     // halt
 #include "console.h"        // console_printf
 #include "process.h"        // current, process_dump, process_exit
-#include "interrupt.h"      // interrupt_dump_process
+#include "interrupt.h"      // interrupt_dump_process, interrupt_save
+#include "mmap.h"           // mmap_handle_fault
+#include "swap.h"           // swap_in, swap_free, swap_reclaim_wait
+#include "memorylayout.h"   // PROCESS_ENTRY_POINT, KERNEL_KMAP_START
+#include "bitmap.h"
+
+#ifdef NUNYA_PAE
+
+// With PAE, entries are 64 bits wide, so a table holds 512 of them, and a
+// third level is added on top: a page directory pointer table with one
+// entry per GB, each pointing to a page directory.
+#define ENTRIES_PER_TABLE (PAGE_SIZE/8)
+#define TABLE_INDEX(vaddr) (((vaddr) >> 12) & 0x1ff)
+
+struct pageentry {
+    uint64_t present:1;         // 1 = present
+    uint64_t readwrite:1;       // 1 = writable
+    uint64_t user:1;            // 1 = user mode
+    uint64_t writethrough:1;    // 1 = write through
+
+    uint64_t nocache:1;         // 1 = no caching
+    uint64_t accessed:1;        // 1 = accessed
+    uint64_t dirty:1;           // 1 = dirty
+    uint64_t pagesize:1;        // leave to zero
+
+    uint64_t globalpage:1;      // 1 if not to be flushed
+    uint64_t avail:3;
+
+    uint64_t addr:40;
+    uint64_t reserved:11;
+    uint64_t noexec:1;
+};  // 64 bits = 8 bytes
+
+// Entries of the page directory pointer table covering kernel space
+#define KERNEL_TOP_ENTRIES (PROCESS_ENTRY_POINT >> 30)
+
+#else
 
 #define ENTRIES_PER_TABLE (PAGE_SIZE/4)
+#define TABLE_INDEX(vaddr) (((vaddr) >> 12) & 0x3ff)
 
 struct pageentry {
     unsigned present:1;         // 1 = present
@@ -32,87 +69,107 @@ struct pageentry {
     unsigned addr:20;
 };  // 32 bits = 4 bytes
 
+// Entries of the page directory covering kernel space
+#define KERNEL_TOP_ENTRIES (PROCESS_ENTRY_POINT >> 22)
+
+#endif
+
+// Amount of memory mapped by one page table
+#define TABLE_SPAN (ENTRIES_PER_TABLE * PAGE_SIZE)
+
+// Bits of the avail field of a page table entry
+#define PAGE_AVAIL_ALLOC    1   // the frame was allocated for this mapping
+#define PAGE_AVAIL_SWAPPED  2   // not present, addr holds the swap slot
+
 struct pagetable {
     struct pageentry entry[ENTRIES_PER_TABLE];
 };
 
-struct pagetable *pagetable_create() {
-    // Each pagetable is one page (4096 bytes) with 2^10 entries
-    // Each process has a 4 MB large pagetable
-    return (struct pagetable *)memory_alloc_page(1);
-}
+// Kernel space is mapped by the same page tables in every process, built
+// once by pagetable_kernel_init
+static struct pagetable *kernel_pagetable = 0;
 
-void pagetable_init(struct pagetable *p) {
-    uint32_t lower_half_memory_top = (2048 - 1) * 1024 * 1024;
-    uint32_t stop = total_memory * 1024 * 1024;
-    if (stop > lower_half_memory_top) {
-        // Cap stop at the 2GB boundary, to avoid direct-mapping the higher
-        // user space memory
-        stop = lower_half_memory_top;
-    }
+// Entries mapping the kmap window, and which of them are free
+static struct pageentry *kmap_entries = 0;
+static uint32_t kmap_free[BITMAP_CELLS(KERNEL_KMAP_PAGES)];
 
-    uint32_t i;
-    for (i = 0; i < stop; i += PAGE_SIZE) {
-        pagetable_map(p, i, i, PAGE_FLAG_KERNEL | PAGE_FLAG_READWRITE);
-    }
+static void pagetable_flush_page(unsigned vaddr) {
+    asm volatile("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
 
-    // SL: in VirtualBox, vram is separate from ram, and no matter how much
-    // physical memory it has, video_buffer is always 0xe0000000.
-    // TODO (SL): [NUN-15] Ensure video buffer is mapped into superviser mode
-    // without vram present
-    stop = (uint32_t)video_buffer + video_xres * video_yres * 3;
-    for (i = (uint32_t)video_buffer; i <= stop; i += PAGE_SIZE) {
-        pagetable_map(p, i, i, PAGE_FLAG_KERNEL | PAGE_FLAG_READWRITE);
+// Only the loaded pagetable has translations in the TLB, apart from kernel
+// space which all of them share
+static int pagetable_in_tlb(struct pagetable *p, unsigned vaddr) {
+    struct pagetable *loaded;
+    if (vaddr < PROCESS_ENTRY_POINT) {
+        return 1;
     }
+    asm volatile("mov %%cr3, %0":"=r"(loaded));
+    return loaded == p;
 }
 
-int pagetable_getmap(struct pagetable *p, unsigned vaddr, unsigned *paddr) {
-    struct pagetable *q;
-    struct pageentry *e;
-
-    unsigned a = vaddr >> 22;           // page directory index: top 10 bits
-    unsigned b = (vaddr >> 12) & 0x3ff; // page table index: middle 10 bits
-
-    e = &p->entry[a];                   // e: page table in directory
-    if (!e->present) {
-        return 0;
+void pagetable_invalidate(struct pagetable *p, unsigned vaddr) {
+    if (pagetable_in_tlb(p, vaddr)) {
+        pagetable_flush_page(vaddr & PAGE_MASK);
     }
+}
 
-    q = (struct pagetable *)(e->addr << 12);    // q: page table address
-
-    e = &q->entry[b];                   // e: physical page address
-    if (!e->present) {
-        return 0;
+void pagetable_invalidate_range(struct pagetable *p, unsigned vaddr,
+                                unsigned length) {
+    if (length == 0 || !pagetable_in_tlb(p, vaddr)) {
+        return;
     }
 
-    *paddr = e->addr << 12;
-
-    return 1;
+    unsigned page = vaddr & PAGE_MASK;
+    unsigned npages = (((vaddr + length - 1) & PAGE_MASK) - page) / PAGE_SIZE + 1;
+    if (npages > PAGETABLE_FLUSH_MAX) {
+        pagetable_refresh();
+        return;
+    }
+    while (npages-- > 0) {
+        pagetable_flush_page(page);
+        page += PAGE_SIZE;
+    }
 }
 
-int pagetable_map(struct pagetable *p, unsigned vaddr, unsigned paddr,
-                  int flags) {
-    struct pagetable *q;
-    struct pageentry *e;
+void pagetable_gather_init(struct pagetable_gather *g, struct pagetable *p) {
+    g->p = p;
+    g->start = PAGE_MASK;
+    g->last = 0;
+}
 
-    unsigned a = vaddr >> 22;
-    unsigned b = (vaddr >> 12) & 0x3ff;
+void pagetable_gather_add(struct pagetable_gather *g, unsigned vaddr) {
+    unsigned page = vaddr & PAGE_MASK;
+    if (page < g->start) {
+        g->start = page;
+    }
+    if (page > g->last) {
+        g->last = page;
+    }
+}
 
-    // If we need to allocate the page, allocate first
-    // TODO (SL): if the virtual address is already mapped in the page table,
-    // what should we do?
-    if (flags & PAGE_FLAG_ALLOC) {
-        paddr = (unsigned)memory_alloc_page(0);
-        if (!paddr) {
-            return 0;
-        }
+void pagetable_gather_flush(struct pagetable_gather *g) {
+    if (g->start <= g->last) {
+        pagetable_invalidate_range(g->p, g->start,
+                                   g->last - g->start + PAGE_SIZE);
     }
+    pagetable_gather_init(g, g->p);
+}
 
-    e = &p->entry[a];
+struct pagetable *pagetable_create() {
+    // Each pagetable is one page (4096 bytes)
+    return (struct pagetable *)memory_alloc_page(1);
+}
 
+// Return the table an upper level entry points to. If there is none, it is
+// created when create is set, and 0 is returned otherwise.
+static struct pagetable *pagetable_next_level(struct pageentry *e, int create,
+                                              int flags) {
     if (!e->present) {
-        // Create page directory entry
-        q = pagetable_create();
+        if (!create) {
+            return 0;
+        }
+        struct pagetable *q = pagetable_create();
         if (!q) {
             return 0;
         }
@@ -127,63 +184,408 @@ int pagetable_map(struct pagetable *p, unsigned vaddr, unsigned paddr,
         e->globalpage = (flags & PAGE_FLAG_KERNEL) ? 1 : 0;
         e->avail = 0;
         e->addr = (((unsigned)q) >> 12);
-    } else {
-        q = (struct pagetable *)(((unsigned)e->addr) << 12);
+    }
+    return (struct pagetable *)(unsigned)(e->addr << 12);
+}
+
+// Find the entry of vaddr in its page table. If the page table does not
+// exist, it is created when create is set, and 0 is returned otherwise.
+static struct pageentry *pagetable_lookup(struct pagetable *p, unsigned vaddr,
+                                          int create, int flags) {
+    struct pagetable *q;
+
+#ifdef NUNYA_PAE
+    // Page directories are all set up by pagetable_init, because the CPU
+    // only reads the pointer table when %cr3 is loaded
+    struct pageentry *e = &p->entry[vaddr >> 30];
+    if (!e->present) {
+        return 0;
+    }
+    q = (struct pagetable *)(unsigned)(e->addr << 12);
+    q = pagetable_next_level(&q->entry[(vaddr >> 21) & 0x1ff], create, flags);
+#else
+    q = pagetable_next_level(&p->entry[vaddr >> 22], create, flags);
+#endif
+    if (!q) {
+        return 0;
     }
 
-    e = &q->entry[b];
+    return &q->entry[TABLE_INDEX(vaddr)];
+}
 
-    // Create page table entry
+static void pagetable_set_entry(struct pageentry *e, unsigned pfn, int flags) {
     e->present = 1;
     e->readwrite = (flags & PAGE_FLAG_READWRITE) ? 1 : 0;
     e->user = (flags & PAGE_FLAG_KERNEL) ? 0 : 1;
     e->writethrough = 0;
     e->nocache = 0;
-    e->accessed = 0;
-    e->dirty = 0;
+    // New pages start out referenced, so the swap clock gives them a chance
+    // to be used. Only a freshly cleared page matches what a fault would
+    // give back, so anything else starts out dirty.
+    e->accessed = 1;
+    e->dirty = (flags & PAGE_FLAG_CLEAR) ? 0 : 1;
     e->pagesize = 0;
     e->globalpage = !e->user;
-    e->avail = (flags & PAGE_FLAG_ALLOC) ? 1 : 0;
-    e->addr = (paddr >> 12);
+    e->avail = (flags & PAGE_FLAG_ALLOC) ? PAGE_AVAIL_ALLOC : 0;
+    e->addr = pfn;
+}
+
+#ifdef NUNYA_PAE
+// Point a top level entry at a page directory
+static void pagetable_set_top(struct pageentry *e, struct pagetable *q) {
+    memset(e, 0, sizeof(*e));
+    e->present = 1;
+    e->addr = ((unsigned)q) >> 12;
+}
+#endif
+
+// SL: in VirtualBox, vram is separate from ram, and no matter how much
+// physical memory it has, video_buffer is always 0xe0000000.
+// TODO (SL): [NUN-15] Ensure video buffer is mapped into superviser mode
+// without vram present
+static void pagetable_map_video(struct pagetable *p) {
+    uint32_t i, stop;
+    stop = (uint32_t)video_buffer + video_xres * video_yres * 3;
+    for (i = (uint32_t)video_buffer; i <= stop; i += PAGE_SIZE) {
+        pagetable_map(p, i, i, PAGE_FLAG_KERNEL | PAGE_FLAG_READWRITE);
+    }
+}
+
+void pagetable_kernel_init() {
+    uint32_t i;
+    uint32_t stop = memory_direct_map_end();
+
+    kernel_pagetable = pagetable_create();
+#ifdef NUNYA_PAE
+    // The entries above kernel space are only for the video buffer mapping
+    // below; processes get their own
+    for (i = 0; i < 4; i++) {
+        pagetable_set_top(&kernel_pagetable->entry[i], pagetable_create());
+    }
+#endif
+
+    // Direct map all the memory the kernel allocates from
+    for (i = 0; i < stop; i += PAGE_SIZE) {
+        pagetable_map(kernel_pagetable, i, i, PAGE_FLAG_KERNEL | PAGE_FLAG_READWRITE);
+    }
+
+    // Create the page tables of the rest of kernel space up front, so that
+    // mappings added there later show up in every process
+    for (i = KERNEL_DIRECT_MAP_END; i < PROCESS_ENTRY_POINT; i += TABLE_SPAN) {
+        pagetable_lookup(kernel_pagetable, i, 1, PAGE_FLAG_KERNEL);
+    }
+
+    // Kernel threads run on this page table, and draw on the screen
+    pagetable_map_video(kernel_pagetable);
+
+    kmap_entries = pagetable_lookup(kernel_pagetable, KERNEL_KMAP_START, 0, 0);
+    for (i = 0; i < KERNEL_KMAP_PAGES; i++) {
+        bitmap_set(kmap_free, i);
+    }
+}
+
+struct pagetable *pagetable_kernel() {
+    return kernel_pagetable;
+}
+
+void pagetable_init(struct pagetable *p) {
+    uint32_t i;
+
+    for (i = 0; i < KERNEL_TOP_ENTRIES; i++) {
+        p->entry[i] = kernel_pagetable->entry[i];
+    }
+#ifdef NUNYA_PAE
+    for (i = KERNEL_TOP_ENTRIES; i < 4; i++) {
+        pagetable_set_top(&p->entry[i], pagetable_create());
+    }
+#endif
+
+    pagetable_map_video(p);
+}
+
+void *pagetable_kmap(unsigned frame) {
+    if (frame < memory_direct_map_end() >> PAGE_BITS) {
+        return (void *)(frame << PAGE_BITS);
+    }
+
+    // The slot bitmap is shared by every process, and kmap is also used from
+    // interrupt handlers
+    unsigned flags = interrupt_save();
+    int32_t slot = bitmap_first_set(kmap_free, BITMAP_CELLS(KERNEL_KMAP_PAGES));
+    if (slot < 0) {
+        console_printf("pagetable: kmap window is full\n");
+        halt();
+    }
+    bitmap_clear(kmap_free, slot);
+    interrupt_restore(flags);
+
+    unsigned vaddr = KERNEL_KMAP_START + slot * PAGE_SIZE;
+    pagetable_set_entry(&kmap_entries[slot], frame,
+                        PAGE_FLAG_KERNEL | PAGE_FLAG_READWRITE);
+    pagetable_flush_page(vaddr);
+    return (void *)vaddr;
+}
+
+void pagetable_kunmap(void *addr) {
+    unsigned vaddr = (unsigned)addr;
+    if (vaddr < KERNEL_KMAP_START || vaddr >= PROCESS_ENTRY_POINT) {
+        // Direct mapped
+        return;
+    }
+
+    unsigned slot = (vaddr - KERNEL_KMAP_START) / PAGE_SIZE;
+    kmap_entries[slot].present = 0;
+    pagetable_flush_page(vaddr & PAGE_MASK);
+
+    // Same as the claim in pagetable_kmap
+    unsigned flags = interrupt_save();
+    bitmap_set(kmap_free, slot);
+    interrupt_restore(flags);
+}
+
+int pagetable_getframe(struct pagetable *p, unsigned vaddr, unsigned *frame) {
+    struct pageentry *e = pagetable_lookup(p, vaddr, 0, 0);
+    if (!e || !e->present) {
+        return 0;
+    }
+
+    *frame = e->addr;
 
     return 1;
 }
 
-void pagetable_unmap(struct pagetable *p, unsigned vaddr) {
-    struct pagetable *q;
+// Record in its struct page that a frame was allocated for a user page
+static void pagetable_own_frame(struct pagetable *p, unsigned vaddr,
+                                unsigned frame) {
+    struct page *page = memory_frame_page(frame);
+    if (page) {
+        page->flags = PAGE_STATE_USER;
+        page->owner = p;
+        page->index = vaddr >> PAGE_BITS;
+    }
+}
+
+// Only private pages that are not pinned can be pushed out to swap
+static int pagetable_frame_evictable(unsigned frame) {
+    struct page *page = memory_frame_page(frame);
+    return !page || (page->count == 1 && !(page->flags & PAGE_STATE_PINNED));
+}
+
+int pagetable_map(struct pagetable *p, unsigned vaddr, unsigned paddr,
+                  int flags) {
+    return pagetable_map_frame(p, vaddr, paddr >> PAGE_BITS, flags);
+}
+
+int pagetable_map_frame(struct pagetable *p, unsigned vaddr, unsigned frame,
+                        int flags) {
     struct pageentry *e;
+    unsigned pfn = frame;
+
+    // If we need to allocate the page, allocate first
+    // TODO (SL): if the virtual address is already mapped in the page table,
+    // what should we do?
+    if (flags & PAGE_FLAG_ALLOC) {
+        bool clear = (flags & PAGE_FLAG_CLEAR) ? 1 : 0;
+        if (flags & PAGE_FLAG_KERNEL) {
+            pfn = (unsigned)memory_alloc_page(clear) >> PAGE_BITS;
+        } else {
+            pfn = memory_alloc_frame(clear);
+        }
+        if (!pfn) {
+            return 0;
+        }
+        if (!(flags & PAGE_FLAG_KERNEL)) {
+            pagetable_own_frame(p, vaddr, pfn);
+        }
+    }
+
+    e = pagetable_lookup(p, vaddr, 1, flags);
+    if (!e) {
+        if (flags & PAGE_FLAG_ALLOC) {
+            memory_free_frame(pfn);
+        }
+        return 0;
+    }
+
+    // Create page table entry. A translation is only cached for present
+    // entries, so only a remapping needs to be invalidated.
+    int remap = e->present;
+    pagetable_set_entry(e, pfn, flags);
+    if (remap) {
+        pagetable_invalidate(p, vaddr);
+    }
+
+    return 1;
+}
+
+unsigned pagetable_populate(struct pagetable *p, unsigned vaddr,
+                            unsigned npages, unsigned max_new, int flags) {
+    struct pageentry *e = 0;
+    unsigned mapped = 0;
+
+    vaddr &= PAGE_MASK;
+
+    while (npages > 0 && mapped < max_new) {
+        // Entries of one page table are consecutive, so the directory is
+        // only walked again when crossing into the next page table
+        if (!e || TABLE_INDEX(vaddr) == 0) {
+            e = pagetable_lookup(p, vaddr, 1, flags);
+            if (!e) {
+                break;
+            }
+        }
+        if (!e->present) {
+            unsigned pfn = memory_alloc_frame((flags & PAGE_FLAG_CLEAR) ? 1 : 0);
+            if (!pfn) {
+                break;
+            }
+            pagetable_set_entry(e, pfn, flags | PAGE_FLAG_ALLOC);
+            pagetable_own_frame(p, vaddr, pfn);
+            mapped++;
+        }
+        e++;
+        vaddr += PAGE_SIZE;
+        npages--;
+    }
+    return mapped;
+}
+
+// Clear the entry of vaddr, and return whether it was present
+static int pagetable_clear_entry(struct pagetable *p, unsigned vaddr) {
+    struct pageentry *e = pagetable_lookup(p, vaddr, 0, 0);
+    if (!e) {
+        return 0;
+    }
+    int present = e->present;
+    e->present = 0;
+    e->avail = 0;
+    return present;
+}
+
+void pagetable_unmap(struct pagetable *p, unsigned vaddr) {
+    if (pagetable_clear_entry(p, vaddr)) {
+        pagetable_invalidate(p, vaddr);
+    }
+}
+
+void pagetable_gather_unmap(struct pagetable_gather *g, unsigned vaddr) {
+    if (pagetable_clear_entry(g->p, vaddr)) {
+        pagetable_gather_add(g, vaddr);
+    }
+}
 
-    unsigned a = vaddr >> 22;
-    unsigned b = vaddr >> 12 & 0x3ff;
+int pagetable_clock_scan(struct pagetable *p, unsigned *vaddr,
+                         unsigned *frame) {
+    unsigned v = *vaddr & PAGE_MASK;
+    struct pagetable_gather g;
 
-    e = &p->entry[a];
-    if (e->present) {
-        q = (struct pagetable *)(e->addr << 12);
-        e = &q->entry[b];
+    pagetable_gather_init(&g, p);
+
+    // v wraps around to 0 past the top of the address space
+    while (v >= PROCESS_ENTRY_POINT) {
+        struct pageentry *e = pagetable_lookup(p, v, 0, 0);
+        if (!e) {
+            // Skip the range of a missing page table at once
+            v = (v | (TABLE_SPAN - 1)) + 1;
+            continue;
+        }
+        do {
+            if (e->present && e->user && (e->avail & PAGE_AVAIL_ALLOC) &&
+                pagetable_frame_evictable(e->addr)) {
+                if (e->accessed) {
+                    // Second chance. The CPU only sets the bit again when
+                    // it walks the table, so the translation must go.
+                    e->accessed = 0;
+                    pagetable_gather_add(&g, v);
+                } else {
+                    pagetable_gather_flush(&g);
+                    *vaddr = v;
+                    *frame = e->addr;
+                    return e->dirty ? PAGETABLE_PAGE_DIRTY : PAGETABLE_PAGE_CLEAN;
+                }
+            }
+            e++;
+            v += PAGE_SIZE;
+        } while (TABLE_INDEX(v));
+    }
+    pagetable_gather_flush(&g);
+    return 0;
+}
+
+void pagetable_swap_out(struct pagetable *p, unsigned vaddr, unsigned slot) {
+    struct pageentry *e = pagetable_lookup(p, vaddr, 0, 0);
+    if (e) {
         e->present = 0;
+        e->avail = PAGE_AVAIL_SWAPPED;
+        e->addr = slot;
+        pagetable_invalidate(p, vaddr);
+    }
+}
+
+void pagetable_swap_in(struct pagetable *p, unsigned vaddr, unsigned frame) {
+    struct pageentry *e = pagetable_lookup(p, vaddr, 0, 0);
+    if (e) {
+        pagetable_set_entry(e, frame, PAGE_FLAG_USER | PAGE_FLAG_READWRITE |
+                                    PAGE_FLAG_ALLOC);
+        pagetable_own_frame(p, vaddr, frame);
+    }
+}
+
+int pagetable_getswap(struct pagetable *p, unsigned vaddr, unsigned *slot) {
+    struct pageentry *e = pagetable_lookup(p, vaddr, 0, 0);
+    if (!e || e->present || !(e->avail & PAGE_AVAIL_SWAPPED)) {
+        return 0;
     }
+    *slot = e->addr;
+    return 1;
+}
+
+// Free a page table of user space along with the swap slots it owns, and
+// drop its references to the frames it allocated, which are only freed once
+// nothing else shares them
+static void pagetable_delete_table(struct pagetable *q) {
+    unsigned j;
+    for (j = 0; j < ENTRIES_PER_TABLE; j++) {
+        struct pageentry *e = &q->entry[j];
+        if (e->present && (e->avail & PAGE_AVAIL_ALLOC)) {
+            memory_free_frame(e->addr);
+        } else if (!e->present && (e->avail & PAGE_AVAIL_SWAPPED)) {
+            swap_free(e->addr);
+        }
+    }
+    memory_free_page(q);
 }
 
 void pagetable_delete(struct pagetable *p) {
-    unsigned i, j;
+    unsigned i;
 
     struct pageentry *e;
-    struct pagetable *q;
 
-    for (i = 0; i < ENTRIES_PER_TABLE; i++) {
+    // The kernel space tables are shared, only user space is freed
+#ifdef NUNYA_PAE
+    for (i = KERNEL_TOP_ENTRIES; i < 4; i++) {
         e = &p->entry[i];
         if (e->present) {
-            q = (struct pagetable *)(e->addr << 12);
+            struct pagetable *d = (struct pagetable *)(unsigned)(e->addr << 12);
+            unsigned j;
             for (j = 0; j < ENTRIES_PER_TABLE; j++) {
-                e = &q->entry[i];
-                if (e->present && e->avail) {
-                    void *paddr = (void *)(e->addr << 12);
-                    memory_free_page(paddr);
+                struct pagetable *q = pagetable_next_level(&d->entry[j], 0, 0);
+                if (q) {
+                    pagetable_delete_table(q);
                 }
             }
-            memory_free_page(q);
+            memory_free_page(d);
         }
     }
+#else
+    for (i = KERNEL_TOP_ENTRIES; i < ENTRIES_PER_TABLE; i++) {
+        e = &p->entry[i];
+        if (e->present) {
+            pagetable_delete_table((struct pagetable *)(e->addr << 12));
+        }
+    }
+#endif
+    memory_free_page(p);
 }
 
 void pagetable_alloc(struct pagetable *p, unsigned vaddr, unsigned length,
@@ -194,16 +596,7 @@ void pagetable_alloc(struct pagetable *p, unsigned vaddr, unsigned length,
         npages++;
     }
 
-    vaddr &= 0xfffff000;
-
-    while (npages > 0) {
-        unsigned paddr;
-        if (!pagetable_getmap(p, vaddr, &paddr)) {
-            pagetable_map(p, vaddr, 0, flags | PAGE_FLAG_ALLOC);
-        }
-        vaddr += PAGE_SIZE;
-        npages--;
-    }
+    pagetable_populate(p, vaddr, npages, npages, flags);
 }
 
 struct pagetable *pagetable_load(struct pagetable *p) {
@@ -219,6 +612,12 @@ void pagetable_refresh() {
 }
 
 void pagetable_enable() {
+#ifdef NUNYA_PAE
+    // PAE has to be on before paging is
+    asm("movl %cr4, %eax");
+    asm("orl $0x20, %eax");
+    asm("movl %eax, %cr4");
+#endif
     asm("movl %cr0, %eax");
     asm("orl $0x80000000, %eax");
     asm("movl %eax, %cr0");
@@ -227,6 +626,13 @@ void pagetable_enable() {
 void pagetable_copy(struct pagetable *sp, unsigned saddr,
                     struct pagetable *tp, unsigned taddr, unsigned length);
 
+// The fault handler cannot reclaim memory itself. When a fault ran out of
+// frames, it waits for the worker thread to push pages out to swap, and the
+// access faults again.
+static int pagetable_fault_retry() {
+    return memory_pages_free() == 0 && swap_reclaim_wait() > 0;
+}
+
 void exception_handle_pagefault(int intr, int code) {
     // vector index should be 14; otherwise something really wrong happened
     if (intr != 14) {
@@ -235,35 +641,41 @@ void exception_handle_pagefault(int intr, int code) {
         halt();
     }
 
-    uint32_t vaddr, paddr;
+    uint32_t vaddr;
     asm("mov %%cr2, %0":"=r"(vaddr));
     // When a page fault exception is thrown, test if the vaddr is mapped
-    if (pagetable_getmap(current->pagetable, vaddr, &paddr)) {
+    struct pageentry *e = pagetable_lookup(current->pagetable, vaddr, 0, 0);
+    if (e && e->present) {
         // If it's mapped, then it means we can't access the vaddr.
         // Dump the process
         console_printf("interrupt: illegal page access at vaddr %x\n",
                        vaddr);
         process_dump(current);
         process_exit(0);
-    } else {
-        // Otherwise, we know we have a legit page fault
-        // If we can't allocate additional memory, kill the process
-        if (0) {
+    } else if (e && (e->avail & PAGE_AVAIL_SWAPPED)) {
+        // The page was pushed out to swap, bring it back
+        if (!swap_in(current, vaddr & PAGE_MASK, (unsigned)e->addr)) {
+            if (pagetable_fault_retry()) {
+                return;
+            }
+            console_printf("interrupt: cannot swap in page at vaddr %x\n",
+                           vaddr);
             interrupt_dump_process();
         }
-
-        int number_of_pages_left = current->permissions->max_number_of_pages - current->number_of_pages_using;
-        // check the permissions of the process
-        if (number_of_pages_left > 0) {
-            // allocate the page
-            pagetable_alloc(current->pagetable, vaddr, PAGE_SIZE,
-            // TODO(SL): figure out if these flags are correct
-            PAGE_FLAG_READWRITE | PAGE_FLAG_USER | PAGE_FLAG_ALLOC);
-
-            // increment the process' counter
-            current->number_of_pages_using++;
-        } else {
-            console_printf("Error: process exceeded page limit\n");
+    } else {
+        // Otherwise, it is only legit if the vaddr is in one of the
+        // process' address space areas
+        int mapped = mmap_handle_fault(current, vaddr);
+        if (mapped == 0) {
+            console_printf("interrupt: segmentation fault at vaddr %x\n",
+                           vaddr);
+            interrupt_dump_process();
+        } else if (mapped < 0) {
+            if (pagetable_fault_retry()) {
+                return;
+            }
+            console_printf("interrupt: cannot map page at vaddr %x\n",
+                           vaddr);
             interrupt_dump_process();
         }
     }
@@ -18,6 +18,25 @@ See the file LICENSE for details.
 #define PAGE_FLAG_NOCLEAR     0
 #define PAGE_FLAG_CLEAR       8
 
+// Victims returned by pagetable_clock_scan
+#define PAGETABLE_PAGE_CLEAN  1
+#define PAGETABLE_PAGE_DIRTY  2
+
+// Past this many pages, reloading %cr3 is cheaper than invalidating each page
+#define PAGETABLE_FLUSH_MAX   32
+
+/**
+ * @brief   A batch of translations to invalidate
+ * @details Collects the pages whose mappings changed in one page directory,
+ *          so that a single flush invalidates all of them once the changes
+ *          are done. Initialize it with pagetable_gather_init.
+ */
+struct pagetable_gather {
+    struct pagetable *p;
+    unsigned start;         // lowest page gathered
+    unsigned last;          // highest page gathered
+};
+
 /**
  * @brief   Create a pagetable
  * @details Allocates a pagetable in memory. Each pagetable is one memory page
@@ -28,10 +47,28 @@ See the file LICENSE for details.
  */
 struct pagetable *pagetable_create();
 
+/**
+ * @brief   Build the kernel space page tables
+ * @details Direct maps the memory managed by memory_raw.c, and creates the
+ *          page tables of the rest of kernel space, including the kmap
+ *          window. These tables are shared by every process, so this must be
+ *          called once, before the first pagetable_init.
+ */
+void pagetable_kernel_init();
+
+/**
+ * @brief   The pagetable built by pagetable_kernel_init
+ * @details Its kernel space tables are shared by every pagetable, so kernel
+ *          space mappings made in it show up in every process.
+ *
+ * @return  A pointer to the kernel pagetable
+ */
+struct pagetable *pagetable_kernel();
+
 /**
  * @brief   Initialize a direct-mapped pagetable
- * @details Initialize a given pagetable by direct mapping kernel space memory
- *          up until 2GB, and direct mapping video memory for the video system.
+ * @details Initialize a given pagetable by sharing the kernel space page
+ *          tables, and direct mapping video memory for the video system.
  *          TODO (SL): we should ensure video memory is correctly mapped into
  *          kernel space even without vram in the future.
  *
@@ -39,6 +76,24 @@ struct pagetable *pagetable_create();
  */
 void pagetable_init(struct pagetable *p);
 
+/**
+ * @brief   Make a page frame accessible to the kernel
+ * @details Frames of the direct map are returned as is. Others are mapped at
+ *          a free slot of the kmap window, which must be given back with
+ *          pagetable_kunmap.
+ *
+ * @param   frame   The frame number
+ * @return  A kernel address of the frame
+ */
+void *pagetable_kmap(unsigned frame);
+
+/**
+ * @brief   Release an address returned by pagetable_kmap
+ *
+ * @param   addr    The address returned by pagetable_kmap
+ */
+void pagetable_kunmap(void *addr);
+
 /**
  * @brief   Map a virtual address to a physical address in a page directory
  * @details Given a virtual address, the pagetable maps its page to a given
@@ -56,30 +111,155 @@ int pagetable_map(struct pagetable *p, unsigned vaddr, unsigned paddr,
                   int flags);
 
 /**
- * @brief   Get the physical address of a virtual address in a page directory
- * @details Given a virtual address, the pagetable gets its corresponding
- *          physical address. The lookup is successful if the vaddr is mapped
- *          to a paddr, and the page is currently in memory.
+ * @brief   Map a virtual address to a page frame in a page directory
+ * @details Like pagetable_map, but takes a frame number, so that frames
+ *          above 4GB can be mapped as well.
+ *
+ * @param   p       A pointer to the page directory to be modified
+ * @param   vaddr   Virtual address to be mapped
+ * @param   frame   Frame number to be mapped. If PAGE_FLAG_ALLOC is passed
+ *                  in, frame is ignored
+ * @param   flags   Flags of the new pages
+ * @return  1 if the mapping is successful, and 0 otherwise
+ */
+int pagetable_map_frame(struct pagetable *p, unsigned vaddr, unsigned frame,
+                        int flags);
+
+/**
+ * @brief   Get the page frame of a virtual address in a page directory
+ * @details Given a virtual address, the pagetable gets the number of the
+ *          physical frame holding its page. The lookup is successful if the
+ *          vaddr is mapped, and the page is currently in memory. The frame
+ *          may lie outside the direct map; use pagetable_kmap to access it.
  *
  * @param   p       A pointer to the page directory to be looked up
  * @param   vaddr   Virtual address to be looked up
- * @param   paddr   A pointer to store the looked up physical address
+ * @param   frame   A pointer to store the looked up frame number
  * @return  1 if the lookup is successful; 0 if the virtual address is not
  *          mapped to any physical address, or if the page isn't currently in
  *          memory
  */
-int pagetable_getmap(struct pagetable *p, unsigned vaddr, unsigned *paddr);
+int pagetable_getframe(struct pagetable *p, unsigned vaddr, unsigned *frame);
 
 /**
  * @brief   Unmap a page from a given pagetable
  * @details Given a virtual address, the pagetable marks the corresponding page
- *          as "not in memory" in the given pagetable.
+ *          as "not in memory" in the given pagetable, and invalidates its
+ *          translation.
  *
  * @param   p       A pointer to the pagetable to be modified
  * @param   vaddr   A virtual address in the page
  */
 void pagetable_unmap(struct pagetable *p, unsigned vaddr);
 
+/**
+ * @brief   Unmap a page, deferring the invalidation to a gather
+ * @details Like pagetable_unmap, but the translation stays valid until
+ *          pagetable_gather_flush is called on g.
+ *
+ * @param   g       The gather of the pagetable to be modified
+ * @param   vaddr   A virtual address in the page
+ */
+void pagetable_gather_unmap(struct pagetable_gather *g, unsigned vaddr);
+
+/**
+ * @brief   Invalidate the translation of one page
+ * @details Nothing is done when p is not the loaded pagetable, unless the
+ *          page is in kernel space, which every pagetable shares.
+ *
+ * @param   p       The pagetable whose mapping changed
+ * @param   vaddr   A virtual address in the page
+ */
+void pagetable_invalidate(struct pagetable *p, unsigned vaddr);
+
+/**
+ * @brief   Invalidate the translations of a range of pages
+ * @details Pages are invalidated one by one, unless there are more than
+ *          PAGETABLE_FLUSH_MAX of them, in which case the whole TLB is.
+ *
+ * @param   p       The pagetable whose mappings changed
+ * @param   vaddr   The start of the range
+ * @param   length  The length of the range in bytes
+ */
+void pagetable_invalidate_range(struct pagetable *p, unsigned vaddr,
+                                unsigned length);
+
+/**
+ * @brief   Start gathering the pages to invalidate in a pagetable
+ *
+ * @param   g   The gather to initialize
+ * @param   p   The pagetable whose mappings are about to change
+ */
+void pagetable_gather_init(struct pagetable_gather *g, struct pagetable *p);
+
+/**
+ * @brief   Add a page to a gather
+ *
+ * @param   g       The gather
+ * @param   vaddr   A virtual address in the page
+ */
+void pagetable_gather_add(struct pagetable_gather *g, unsigned vaddr);
+
+/**
+ * @brief   Invalidate all the pages of a gather
+ * @details The gather is left empty, ready for more pages.
+ *
+ * @param   g   The gather
+ */
+void pagetable_gather_flush(struct pagetable_gather *g);
+
+/**
+ * @brief   Find the next user page to evict with the second-chance clock
+ * @details Scans the allocated user pages from *vaddr up to the top of the
+ *          address space, skipping those whose frame is shared or pinned.
+ *          Pages referenced since the last scan get their accessed bit
+ *          cleared and are skipped; the first page that was
+ *          not referenced is the victim. The translations of the cleared
+ *          pages are invalidated, so the CPU sets the bit again on their next
+ *          use.
+ *
+ * @param   p       A pointer to the page directory to scan
+ * @param   vaddr   Where to start scanning; set to the victim's address
+ * @param   frame   Set to the victim's frame number
+ * @return  PAGETABLE_PAGE_DIRTY if the victim must be written out,
+ *          PAGETABLE_PAGE_CLEAN if it still holds the zeros it was mapped
+ *          with, and 0 if the scan reached the top of the address space
+ */
+int pagetable_clock_scan(struct pagetable *p, unsigned *vaddr,
+                         unsigned *frame);
+
+/**
+ * @brief   Mark a page as swapped out
+ * @details The page becomes not present, and its entry records the swap slot
+ *          holding the data. Its translation is invalidated, and its frame is
+ *          left to the caller.
+ *
+ * @param   p       A pointer to the page directory to be modified
+ * @param   vaddr   A virtual address in the page
+ * @param   slot    The swap slot holding the page
+ */
+void pagetable_swap_out(struct pagetable *p, unsigned vaddr, unsigned slot);
+
+/**
+ * @brief   Map the frame holding a page read back from swap
+ *
+ * @param   p       A pointer to the page directory to be modified
+ * @param   vaddr   A virtual address in the page
+ * @param   frame   The frame number now holding the data, owned by the
+ *                  mapping
+ */
+void pagetable_swap_in(struct pagetable *p, unsigned vaddr, unsigned frame);
+
+/**
+ * @brief   Get the swap slot of a swapped out page
+ *
+ * @param   p       A pointer to the page directory to be looked up
+ * @param   vaddr   A virtual address in the page
+ * @param   slot    A pointer to store the swap slot
+ * @return  1 if the page is swapped out, 0 otherwise
+ */
+int pagetable_getswap(struct pagetable *p, unsigned vaddr, unsigned *slot);
+
 /**
  * @brief   Allocate pagetables and map a given virtual address and length
  * @details Given a virtual address, the pagetable allocates physical memory and
@@ -93,6 +273,23 @@ void pagetable_unmap(struct pagetable *p, unsigned vaddr);
 void pagetable_alloc(struct pagetable *p, unsigned vaddr, unsigned length,
                      int flags);
 
+/**
+ * @brief   Map fresh frames into the unmapped pages of a range
+ * @details Pages of the range that are already mapped are left alone. The page
+ *          directory is walked once per page table the range spans rather
+ *          than once per page, so this is the fast path for mapping clusters
+ *          of pages at once.
+ *
+ * @param   p       A pointer to the page directory to be modified
+ * @param   vaddr   Address of the first page of the range
+ * @param   npages  Number of pages in the range
+ * @param   max_new Maximum number of frames to allocate
+ * @param   flags   Flags of the new pages, PAGE_FLAG_ALLOC is implied
+ * @return  The number of pages newly mapped
+ */
+unsigned pagetable_populate(struct pagetable *p, unsigned vaddr,
+                            unsigned npages, unsigned max_new, int flags);
+
 /**
  * @brief   Delete (free) a given pagetable
  * @details Given a page directory, delete all its contents and free the
@@ -121,7 +318,9 @@ void pagetable_enable();
 
 /**
  * @brief   Refresh pagetable
- * @details Reload the currently-enabled pagetable.
+ * @details Reload the currently-enabled pagetable, which invalidates every
+ *          translation. Prefer pagetable_invalidate or a gather when only a
+ *          few pages changed.
  */
 void pagetable_refresh();
 
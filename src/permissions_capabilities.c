@@ -44,6 +44,7 @@ struct process_permissions *permissions_from_capability(struct permissions_capab
     new_permissions->max_height = capability->max_height;
     new_permissions->offset_x = capability->offset_x;
     new_permissions->offset_y = capability->offset_y;
+    new_permissions->priority = capability->priority;
 
     struct list l = LIST_INIT;
     new_permissions->fs_allowances = l;
@@ -100,6 +101,7 @@ uint32_t create_permissions_capability() {
     new_capability->max_height = current->permissions->max_height;
     new_capability->offset_x = 0;
     new_capability->offset_y = 0;
+    new_capability->priority = current->permissions->priority;
 
     struct list l = LIST_INIT;
     new_capability->fs_allowances = l;
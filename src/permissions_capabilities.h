@@ -22,6 +22,10 @@ struct permissions_capability {
     int offset_x;
     int offset_y;
     struct list fs_allowances;
+
+    // Scheduling priority the process starts with, and the highest it may
+    // ask for
+    int priority;
 };
 
 /**
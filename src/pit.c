@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "pit.h"
+#include "ioports.h"
+
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+
+// Controls the gate of channel 2 and the speaker, and shows its output
+#define PIT_PORT_B      0x61
+#define PIT_GATE2       0x01
+#define PIT_SPEAKER     0x02
+#define PIT_OUT2        0x20
+
+#define PIT_MAX_COUNT   0x10000     // a count of 0 stands for 65536
+
+// Channel 0, low byte then high byte, binary counting
+#define PIT_MODE_ONESHOT    0x30    // mode 0, interrupt on terminal count
+#define PIT_MODE_PERIODIC   0x34    // mode 2, rate generator
+
+// The same mode 0 on channel 2
+#define PIT_MODE_DELAY      0xb0
+
+// Read-back command latching both the count and the status of channel 0
+#define PIT_READ_BACK   0xc2
+#define PIT_STATUS_OUT  0x80        // output pin, raised at terminal count
+
+static uint8_t pit_mode = 0;
+
+static void pit_program(uint8_t mode, uint32_t count) {
+    if (count > PIT_MAX_COUNT) {
+        count = PIT_MAX_COUNT;
+    }
+    pit_mode = mode;
+    outb(mode, PIT_COMMAND);
+    outb(count & 0xff, PIT_CHANNEL0);
+    outb((count >> 8) & 0xff, PIT_CHANNEL0);
+}
+
+static void pit_set_periodic(uint32_t count) {
+    pit_program(PIT_MODE_PERIODIC, count);
+}
+
+static void pit_set_oneshot(uint32_t count) {
+    pit_program(PIT_MODE_ONESHOT, count);
+}
+
+static uint32_t pit_read() {
+    outb(PIT_READ_BACK, PIT_COMMAND);
+    uint8_t status = inb(PIT_CHANNEL0);
+    uint32_t count = inb(PIT_CHANNEL0);
+    count |= inb(PIT_CHANNEL0) << 8;
+
+    // Past its terminal count a one-shot counter wraps around and keeps
+    // going, but the output stays up until the channel is programmed again
+    if (pit_mode == PIT_MODE_ONESHOT && (status & PIT_STATUS_OUT)) {
+        return 0;
+    }
+    return count ? count : PIT_MAX_COUNT;
+}
+
+void pit_delay(uint32_t count) {
+    uint8_t port_b = inb(PIT_PORT_B);
+    outb((port_b & ~PIT_SPEAKER) | PIT_GATE2, PIT_PORT_B);
+
+    outb(PIT_MODE_DELAY, PIT_COMMAND);
+    outb(count & 0xff, PIT_CHANNEL2);
+    outb((count >> 8) & 0xff, PIT_CHANNEL2);
+    while (!(inb(PIT_PORT_B) & PIT_OUT2)) {
+        // spin
+    }
+
+    outb(port_b, PIT_PORT_B);
+}
+
+static struct clockevent pit = {
+    .name = "pit",
+    .freq = PIT_FREQ,
+    .max_count = PIT_MAX_COUNT,
+    .irq = 32,
+    .set_periodic = pit_set_periodic,
+    .set_oneshot = pit_set_oneshot,
+    .read = pit_read,
+};
+
+struct clockevent *pit_clockevent() {
+    return &pit;
+}
@@ -0,0 +1,32 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef PIT_H
+#define PIT_H
+
+#include "clockevent.h"
+
+#define PIT_FREQ 1193182
+
+/**
+ * @brief   Busy wait for a number of PIT counts
+ * @details Uses channel 2, which does not raise interrupts, so this works
+ *          with interrupts blocked and leaves the clock alone.
+ *
+ * @param   count   Number of counts, at most 65535
+ */
+void pit_delay(uint32_t count);
+
+/**
+ * @brief   The clock event device of the 8254 programmable interval timer
+ * @details Uses channel 0, which raises IRQ 0, in rate generator mode for the
+ *          periodic tick and in interrupt on terminal count mode for
+ *          one-shots. Its counter is 16 bits wide, so a one-shot lasts 55ms
+ *          at most.
+ */
+struct clockevent *pit_clockevent();
+
+#endif
@@ -14,14 +14,34 @@ See the file LICENSE for details.
 #include "memorylayout.h"
 #include "kernelcore.h"
 #include "graphics.h"
+#include "clock.h"
 
 #include "fs.h" //struct process->files
-#include "memory_raw.h" // memory_alloc_page, memory_free_page
+#include "memory_raw.h" // memory_alloc_page, memory_free_page, memory_zero_pool_fill
 
 #include "permissions_capabilities.h"
+#include "mmap.h"
+#include "swap.h"
+#include "vmalloc.h"
+#include "shrinker.h"
+#include "workqueue.h"
 
 struct process *current = 0;
-struct list ready_list = { 0, 0 };
+struct process *process_all = 0;
+
+// One queue of ready processes per priority level, and a bitmap of the
+// levels whose queue is not empty, so picking the next process is O(1)
+static struct list run_queues[PROCESS_PRIORITY_LEVELS];
+static uint32_t run_levels = 0;
+
+// Exited processes whose stack and page table may still be in use by the
+// switch away from them; the worker thread frees them later
+static struct list zombie_list = LIST_INIT;
+static void process_reap(void *arg);
+static struct work reap_work = WORK_INIT(process_reap, 0);
+
+// Tick of the last time every process went back to its base priority
+static uint32_t boost_tick = 0;
 
 static uint32_t pid_count = 1;
 
@@ -31,6 +51,8 @@ void process_init() {
     // Create a dummy process with no code and no data, and load its pagetable
     // Even though it's dummy, at least kernel memory is direct mapped, so
     // kernel code can run as usual
+    pagetable_kernel_init();
+    vmalloc_init();
     current = process_create(0, 0);
     pagetable_load(current->pagetable);
 
@@ -46,11 +68,21 @@ void process_init() {
     initial_permissions->max_height = graphics_height();
     initial_permissions->offset_x = 0;
     initial_permissions->offset_y = 0;
+    initial_permissions->priority = PROCESS_PRIORITY_DEFAULT;
+
+    // the initial process may access the whole file system
+    struct list l = LIST_INIT;
+    initial_permissions->fs_allowances = l;
+    struct fs_allowance *root_allowance = kmalloc(sizeof(*root_allowance));
+    strcpy(root_allowance->path, "/");
+    root_allowance->do_allow_below = 1;
+    list_push_head(&(initial_permissions->fs_allowances), (struct list_node *)root_allowance);
 
     // todo: the rest of the permissions
 
     console_printf("total pages: %d\n", memory_pages_total());
     current->permissions = initial_permissions;
+    fs_compile_allowances(current);
 
     console_printf("process %d: ready\n", current->pid);
 }
@@ -65,9 +97,10 @@ static void process_stack_init(struct process *p) {
 
     s = (struct x86_stack *)p->stack_ptr;
 
-    s->regs2.ebp = (uint32_t)(p->stack_ptr + 28);
-    s->old_ebp = (uint32_t)(p->stack_ptr + 32);
-    s->old_addr = (unsigned)intr_return;
+    // The first switch_to into the process returns straight into the
+    // interrupt return path, which drops to user mode
+    s->frame.ebp = 0;
+    s->frame.eip = (unsigned)intr_return;
     s->ds = X86_SEGMENT_USER_DATA;
     s->cs = X86_SEGMENT_USER_CODE;
     s->eip = p->entry;
@@ -77,81 +110,155 @@ static void process_stack_init(struct process *p) {
     s->ss = X86_SEGMENT_USER_DATA;
 }
 
-struct process *process_create(unsigned code_size, unsigned stack_size) {
+static void process_link_all(struct process *p) {
+    p->all_prev = 0;
+    p->all_next = process_all;
+    if (process_all) {
+        process_all->all_prev = p;
+    }
+    process_all = p;
+}
+
+struct process *process_create(unsigned code_size, unsigned stack_max) {
     struct process *p;
 
     p = (struct process *)memory_alloc_page(1);
+    if (!p) {
+        return 0;
+    }
     p->pid = pid_count++;
 
     p->pagetable = pagetable_create();
+    if (!p->pagetable) {
+        memory_free_page(p);
+        return 0;
+    }
     pagetable_init(p->pagetable);
     pagetable_alloc(p->pagetable, PROCESS_ENTRY_POINT, code_size,
                     PAGE_FLAG_USER | PAGE_FLAG_READWRITE);
-    pagetable_alloc(p->pagetable, PROCESS_STACK_INIT - stack_size, stack_size,
-                    PAGE_FLAG_USER | PAGE_FLAG_READWRITE);
 
     p->kstack = memory_alloc_page(1);
     p->entry = PROCESS_ENTRY_POINT;
 
-    struct list l = LIST_INIT;
-    p->fs_allowances_list = l;
+    // The page is zeroed, so mmap_cleanup finds no areas if p->kstack failed
+    if (!p->kstack || !mmap_init(p, code_size, stack_max)) {
+        console_printf("process: cannot set up address space areas\n");
+        mmap_cleanup(p);
+        pagetable_delete(p->pagetable);
+        if (p->kstack) {
+            memory_free_page(p->kstack);
+        }
+        memory_free_page(p);
+        return 0;
+    }
 
     fs_init_security(p);
 
     process_stack_init(p);
 
     p->window = 0;
+    p->fpu_used = 0;
+    p->priority = PROCESS_PRIORITY_DEFAULT;
+    p->base_priority = PROCESS_PRIORITY_DEFAULT;
+
+    process_link_all(p);
+
+    return p;
+}
+
+// The run queue helpers expect interrupts to be blocked already
+static void process_make_ready(struct process *p) {
+    p->state = PROCESS_STATE_READY;
+    list_push_tail(&run_queues[p->priority], &p->node);
+    run_levels |= 1 << p->priority;
+}
+
+static void process_unready(struct process *p) {
+    list_remove(&p->node);
+    if (!run_queues[p->priority].head) {
+        run_levels &= ~(1 << p->priority);
+    }
+}
 
+static struct process *process_next_ready() {
+    if (!run_levels) {
+        return 0;
+    }
+    int level = __builtin_ctz(run_levels);
+    struct process *p = (struct process *)list_pop_head(&run_queues[level]);
+    if (!run_queues[level].head) {
+        run_levels &= ~(1 << level);
+    }
     return p;
 }
 
+// Move a process to another level, in the right queue if it is ready
+static void process_move(struct process *p, int priority) {
+    if (p->priority == priority) {
+        return;
+    }
+    if (p->state == PROCESS_STATE_READY) {
+        process_unready(p);
+        p->priority = priority;
+        process_make_ready(p);
+    } else {
+        p->priority = priority;
+    }
+}
+
+static void process_release(struct process *p);
+
 static void process_switch(int newstate) {
+    char **prev_sp = 0;
+
     interrupt_block();
 
     if (current) {
         if (newstate == PROCESS_STATE_GRAVE) {
-            process_cleanup(current);
+            // We are still running on its stack and its page table, so only
+            // those and the process itself wait for the reaper
+            process_release(current);
+            list_push_tail(&zombie_list, &current->node);
+            work_schedule(&reap_work);
         } else if (current->state != PROCESS_STATE_CRADLE) {
-            asm("pushl %ebp");
-            asm("pushl %edi");
-            asm("pushl %esi");
-            asm("pushl %edx");
-            asm("pushl %ecx");
-            asm("pushl %ebx");
-            asm("pushl %eax");
-            asm("movl %%esp, %0":"=r"(current->stack_ptr));
+            prev_sp = &current->stack_ptr;
         }
         interrupt_stack_pointer = (void *)INTERRUPT_STACK_TOP;
         current->state = newstate;
         if (newstate == PROCESS_STATE_READY) {
-            list_push_tail(&ready_list, &current->node);
+            process_make_ready(current);
         }
     }
 
     current = 0;
 
     while (1) {
-        current = (struct process *)list_pop_head(&ready_list);
+        current = process_next_ready();
         if (current) {
             break;
         }
         interrupt_unblock();
-        interrupt_wait();
+        // Use the idle time to bring free memory back over the high
+        // watermark, and then to clear pages for zeroed allocations, a bit
+        // at a time so that a process becoming ready is picked up quickly
+        int busy = shrinker_balance() || memory_zero_pool_fill();
         interrupt_block();
+        if (!busy && !run_levels) {
+            // Sleep without the periodic tick until the next clock deadline
+            // or any other interrupt
+            clock_stop_tick();
+            interrupt_wait();
+            interrupt_block();
+            clock_restart_tick();
+        }
     }
 
     current->state = PROCESS_STATE_RUNNING;
+    current->slice_left =
+        CLOCK_MS_TO_TICKS(PROCESS_TIME_SLICE_MS * (current->priority + 1));
     interrupt_stack_pointer = current->kstack_top;
-    asm("movl %0, %%cr3"::"r"(current->pagetable));
-    asm("movl %0, %%esp"::"r"(current->stack_ptr));
-
-    asm("popl %eax");
-    asm("popl %ebx");
-    asm("popl %ecx");
-    asm("popl %edx");
-    asm("popl %esi");
-    asm("popl %edi");
-    asm("popl %ebp");
+    fpu_switch(current);
+    switch_to(prev_sp, current->stack_ptr, current->pagetable);
 
     interrupt_unblock();
 }
@@ -159,32 +266,126 @@ static void process_switch(int newstate) {
 int allow_preempt = 1;
 
 void process_preempt() {
-    if (allow_preempt && current && ready_list.head) {
+    if (allow_preempt && current && run_levels) {
         process_switch(PROCESS_STATE_READY);
     }
 }
 
+static void process_boost_all() {
+    struct process *p;
+    for (p = process_all; p; p = p->all_next) {
+        process_move(p, p->base_priority);
+    }
+}
+
+void process_tick() {
+    if (!current) {
+        return;
+    }
+    current->cpu_ticks++;
+
+    uint32_t now = clock_ticks();
+    if (now - boost_tick >= CLOCK_MS_TO_TICKS(PROCESS_PRIORITY_BOOST_MS)) {
+        boost_tick = now;
+        process_boost_all();
+    }
+
+    // Using up a whole slice is what CPU hogs do, so they sink a level
+    if (current->slice_left > 0) {
+        current->slice_left--;
+        if (current->slice_left == 0 &&
+            current->priority < PROCESS_PRIORITY_LEVELS - 1) {
+            current->priority++;
+        }
+    }
+
+    // Give way to any process of a higher level right away, and to those of
+    // the same level once the slice is over. With nobody else ready the
+    // slice stays used up, so the process gives way on the first tick after
+    // another one wakes up.
+    int below = current->slice_left ? current->priority : current->priority + 1;
+    uint32_t levels = (1 << below) - 1;
+    if (run_levels & levels) {
+        process_preempt();
+    }
+}
+
+int process_set_priority(struct process *p, int priority) {
+    if (priority < 0 || priority >= PROCESS_PRIORITY_LEVELS ||
+        (p->permissions && priority < p->permissions->priority)) {
+        return -1;
+    }
+    unsigned flags = interrupt_save();
+    p->base_priority = priority;
+    process_move(p, priority);
+    interrupt_restore(flags);
+    return 0;
+}
+
 void process_yield() {
     process_switch(PROCESS_STATE_READY);
 }
 
-void process_cleanup(struct process *p) {
-    // return memory to parent
-    p->parent->number_of_pages_using -= p->permissions->max_number_of_pages;
+// Release everything but the kernel stack, the page table and the structure
+static void process_release(struct process *p) {
+    // return memory to parent; kernel threads have neither
+    if (p->parent && p->permissions) {
+        p->parent->number_of_pages_using -= p->permissions->max_number_of_pages;
+    }
 
-    kfree(p->permissions);
+    fpu_release(p);
+    fs_cleanup(p);
+    fs_free_allowances(p);
+    if (p->permissions) {
+        fs_free_allowances_list(&(p->permissions->fs_allowances));
+        kfree(p->permissions);
+    }
     delete_capabilities_owned_by_process(p);
 
     // todo: kill the process' children
 
     // todo: free additional memory related to process
 
-    // free the actual process struct memory
+    // release shared file pages before the pagetable goes away
+    mmap_cleanup(p);
+
+    swap_forget_process(p);
+    if (p->all_prev) {
+        p->all_prev->all_next = p->all_next;
+    } else {
+        process_all = p->all_next;
+    }
+    if (p->all_next) {
+        p->all_next->all_prev = p->all_prev;
+    }
+}
+
+static void process_free(struct process *p) {
     memory_free_page(p->kstack);
-    pagetable_delete(p->pagetable);
+    if (p->pagetable != pagetable_kernel()) {
+        pagetable_delete(p->pagetable);
+    }
     memory_free_page(p);
 }
 
+static void process_reap(void *arg) {
+    struct process *p;
+    while (1) {
+        interrupt_block();
+        p = (struct process *)list_pop_head(&zombie_list);
+        interrupt_unblock();
+        if (!p) {
+            return;
+        }
+        process_free(p);
+    }
+}
+
+void process_cleanup(struct process *p) {
+    process_release(p);
+    process_free(p);
+}
+
 void process_exit(int code) {
     console_printf("Process %d exiting with status: %d...\n", current->pid, code);
     current->exitcode = code;
@@ -201,25 +402,78 @@ void process_wakeup(struct list *q) {
     struct process *p;
     p = (struct process *)list_pop_head(q);
     if (p) {
-        p->state = PROCESS_STATE_READY;
-        list_push_tail(&ready_list, &p->node);
+        // Waking up from a wait earns the base priority back
+        p->priority = p->base_priority;
+        process_make_ready(p);
     }
 }
 
 void process_wakeup_all(struct list *q) {
     struct process *p;
     while ((p = (struct process *)list_pop_head(q))) {
-        p->state = PROCESS_STATE_READY;
-        list_push_tail(&ready_list, &p->node);
+        p->priority = p->base_priority;
+        process_make_ready(p);
     }
 }
 
 void add_process_to_ready_queue(struct process *p) {
-    list_push_tail(&ready_list, &p->node);
+    process_make_ready(p);
+}
+
+static void process_kernel_start(void (*entry)(void *), void *arg) {
+    // A new thread does not come back through process_switch, so it has to
+    // allow interrupts itself
+    interrupt_unblock();
+    entry(arg);
+    console_printf("process %d: kernel thread returned\n", current->pid);
+    // Nothing can wake it, but its stack and page table stay in use
+    process_switch(PROCESS_STATE_BLOCKED);
+}
+
+struct process *process_create_kernel(void (*entry)(void *), void *arg) {
+    struct process *p;
+    struct x86_switch_frame *f;
+    uint32_t *sp;
+
+    p = (struct process *)memory_alloc_page(1);
+    p->pid = pid_count++;
+
+    // No user space, so the kernel page table does, and switching between
+    // kernel threads keeps cr3
+    p->pagetable = pagetable_kernel();
+    p->parent = 0;
+    p->permissions = 0;
+
+    p->kstack = memory_alloc_page(1);
+    p->kstack_top = p->kstack + PAGE_SIZE;
+
+    // switch_to returns into process_kernel_start as if it had been called
+    // with entry and arg
+    sp = (uint32_t *)p->kstack_top;
+    *--sp = (uint32_t)arg;
+    *--sp = (uint32_t)entry;
+    *--sp = 0;
+    f = (struct x86_switch_frame *)sp - 1;
+    f->ebp = 0;
+    f->eip = (uint32_t)process_kernel_start;
+    p->stack_ptr = (char *)f;
+
+    p->priority = 0;
+    p->base_priority = 0;
+    process_link_all(p);
+
+    unsigned flags = interrupt_save();
+    process_make_ready(p);
+    interrupt_restore(flags);
+    return p;
 }
 
 void process_dump(struct process *p) {
     console_printf("Dumping process %d:\n", p->pid);
+    console_printf("cpu time: %d ms\n",
+                   p->cpu_ticks / CLOCK_HZ * 1000 +
+                   p->cpu_ticks % CLOCK_HZ * 1000 / CLOCK_HZ);
+    console_printf("priority: %d (base %d)\n", p->priority, p->base_priority);
     console_printf("last interrupt: %d\n", last_interrupt);
     struct x86_stack *s =
         (struct x86_stack *)(p->kstack + PAGE_SIZE - sizeof(*s));
@@ -13,6 +13,7 @@ See the file LICENSE for details.
 #include "x86.h"
 #include "memory.h"
 #include "sys_fs_structs.h"
+#include "fpu.h"
 
 #define PROCESS_STATE_CRADLE  0
 #define PROCESS_STATE_READY   1
@@ -20,6 +21,21 @@ See the file LICENSE for details.
 #define PROCESS_STATE_BLOCKED 3
 #define PROCESS_STATE_GRAVE   4
 
+// Time a process at priority 0 may run before another ready process gets
+// the CPU. Each level below gets one more slice of this length.
+#define PROCESS_TIME_SLICE_MS 10
+
+/*
+ * Ready processes wait in one queue per priority level, level 0 running
+ * first. A process starts at its base priority, sinks one level each time
+ * it uses up a whole time slice, and goes back to its base priority when it
+ * wakes up from a wait, and every PROCESS_PRIORITY_BOOST_MS so that the
+ * processes at the bottom do not starve.
+ */
+#define PROCESS_PRIORITY_LEVELS     8
+#define PROCESS_PRIORITY_DEFAULT    2
+#define PROCESS_PRIORITY_BOOST_MS   1000
+
 struct process_permissions {
     // Memory permissions
     int max_number_of_pages;
@@ -30,6 +46,9 @@ struct process_permissions {
     int offset_x;
     int offset_y;
     struct list fs_allowances;
+
+    // Highest base priority the process may ask for, and its initial one
+    int priority;
 };
 
 struct process {
@@ -41,21 +60,69 @@ struct process {
     char *kstack_top;
     char *stack_ptr;
     uint32_t entry;
-    struct fd fd_table[PROCESS_MAX_OPEN_FILES];
+    struct fd *fd_table;
+    uint32_t *fd_free;      // bitmap of free slots in fd_table
+    uint32_t fd_table_size;
     struct process *parent;
     int number_of_pages_using;
     struct process_permissions *permissions;
     struct process_files *files;
-    struct list fs_allowances_list;
+    struct fs_allowance_trie_node *fs_allowances;
+    struct vm_area *vm_areas;   // AVL tree of the valid user address ranges
+    struct vm_area *heap;
+    uint32_t brk;               // current end of the heap
+    struct vm_area *stack;
+    uint32_t stack_limit;       // lowest address the stack may grow down to
+    uint32_t fault_start;       // range mapped by the last anonymous fault
+    uint32_t fault_end;
+    uint32_t fault_window;      // pages mapped per anonymous fault
     struct window *window;
     uint32_t pid;
+    int priority;               // level of the run queue it goes to
+    int base_priority;
+    uint32_t slice_left;        // ticks left in the current time slice
+    uint32_t cpu_ticks;         // ticks spent running
+    struct process *all_next;   // list of every live process
+    struct process *all_prev;
+    int fpu_used;               // fpu holds a state saved by the process
+    uint8_t fpu_area[FPU_AREA_SIZE];
 };
 
 void process_init();
 
-struct process *process_create(unsigned code_size, unsigned stack_size);
+struct process *process_create(unsigned code_size, unsigned stack_max);
+
+/**
+ * @brief   Start a kernel thread
+ * @details The thread runs entry(arg) in kernel mode on its own kernel
+ *          stack, and is scheduled like any process, at priority 0. It has no
+ *          user memory and no permissions. entry must never return.
+ *
+ * @param   entry   The function the thread runs
+ * @param   arg     Its argument
+ * @return  The new thread, already ready to run
+ */
+struct process *process_create_kernel(void (*entry)(void *), void *arg);
 void process_yield();
+
+/**
+ * @brief   Change the base priority of a process
+ * @details The process also moves to its new base priority right away.
+ *
+ * @param   p           The process
+ * @param   priority    The new base priority, from 0, which runs first, to
+ *                      PROCESS_PRIORITY_LEVELS - 1
+ * @return  0 on success, -1 if priority is out of range or above what the
+ *          permissions of the process allow
+ */
+int process_set_priority(struct process *p, int priority);
 void process_preempt();
+
+/*
+ * Called by the clock on every tick, to charge the tick to the running
+ * process and preempt it when its time slice runs out.
+ */
+void process_tick();
 void process_exit(int code);
 void process_dump(struct process *p);
 void process_cleanup(struct process *p);
@@ -67,5 +134,6 @@ void process_wakeup_all(struct list *q);
 void add_process_to_ready_queue(struct process *p);
 
 extern struct process *current;
+extern struct process *process_all;
 
 #endif
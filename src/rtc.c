@@ -15,6 +15,7 @@ Recommended reading: page 11-15 of the RTC data sheet
 #include "console.h"
 #include "string.h"
 #include "interrupt.h"
+#include "clock.h"
 
 #define RTC_BASE 0x80
 
@@ -125,6 +126,7 @@ static void rtc_fetch_time() {
 
 static void rtc_interrupt_handler(int intr, int code) {
     rtc_fetch_time();
+    clock_set_wall(&cached_time);
     rtc_read_port(RTC_REGISTER_C);
 }
 
@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "shrinker.h"
+#include "memory_raw.h"
+#include "console.h"
+#include "interrupt.h"
+
+#define SHRINKER_LOW_FRACTION 64
+#define SHRINKER_LOW_MIN 32
+
+static struct list shrinkers = LIST_INIT;
+
+// Set while the caches are being asked for pages
+static int shrinker_running = 0;
+
+void shrinker_register(struct shrinker *s) {
+    unsigned flags = interrupt_save();
+    list_push_tail(&shrinkers, &s->node);
+    interrupt_restore(flags);
+}
+
+void shrinker_unregister(struct shrinker *s) {
+    unsigned flags = interrupt_save();
+    list_remove(&s->node);
+    interrupt_restore(flags);
+}
+
+uint32_t shrinker_watermark_low() {
+    uint32_t low = memory_pages_total() / SHRINKER_LOW_FRACTION;
+    return low < SHRINKER_LOW_MIN ? SHRINKER_LOW_MIN : low;
+}
+
+uint32_t shrinker_watermark_high() {
+    return 2 * shrinker_watermark_low();
+}
+
+uint32_t shrinker_shrink(uint32_t nr) {
+    struct list_node *n;
+    uint32_t total = 0;
+    uint32_t freed = 0;
+
+    if (nr == 0) {
+        return 0;
+    }
+
+    unsigned flags = interrupt_save();
+    if (shrinker_running) {
+        interrupt_restore(flags);
+        return 0;
+    }
+    shrinker_running = 1;
+    interrupt_restore(flags);
+
+    for (n = shrinkers.head; n; n = n->next) {
+        total += ((struct shrinker *)n)->count();
+    }
+
+    // First give every cache its share, then take whatever is still missing
+    // from the caches in order
+    if (total > 0) {
+        // Each cache is asked for one out of every per pages it could release
+        uint32_t per = (total + nr - 1) / nr;
+        for (n = shrinkers.head; n && freed < nr; n = n->next) {
+            struct shrinker *s = (struct shrinker *)n;
+            uint32_t share = s->count() / per;
+            if (share > 0) {
+                freed += s->scan(share);
+            }
+        }
+        for (n = shrinkers.head; n && freed < nr; n = n->next) {
+            freed += ((struct shrinker *)n)->scan(nr - freed);
+        }
+    }
+
+    shrinker_running = 0;
+    return freed;
+}
+
+uint32_t shrinker_balance() {
+    uint32_t free = memory_pages_free();
+    uint32_t high = shrinker_watermark_high();
+    if (free >= high) {
+        return 0;
+    }
+    uint32_t nr = high - free;
+    return shrinker_shrink(nr < SHRINKER_BATCH ? nr : SHRINKER_BATCH);
+}
+
+void shrinker_report() {
+    struct list_node *n;
+    console_printf("caches: low %d high %d free %d pages\n",
+                   shrinker_watermark_low(), shrinker_watermark_high(),
+                   memory_pages_free());
+    for (n = shrinkers.head; n; n = n->next) {
+        struct shrinker *s = (struct shrinker *)n;
+        console_printf("  %s: %d reclaimable pages\n", s->name, s->count());
+    }
+}
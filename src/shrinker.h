@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef SHRINKER_H
+#define SHRINKER_H
+
+#include "kerneltypes.h"
+#include "list.h"
+
+// Pages asked from the caches by each step of the idle reclaimer
+#define SHRINKER_BATCH 16
+
+/*
+ * A cache that can give pages back when memory runs low. count returns the
+ * number of pages the cache could release right now, and scan releases up to
+ * nr of them, returning how many it did release. Only clean objects that
+ * nobody references may be released, since scan is called from inside the
+ * page allocator.
+ */
+struct shrinker {
+    struct list_node node;
+    const char *name;
+    uint32_t (*count)();
+    uint32_t (*scan)(uint32_t nr);
+};
+
+/**
+ * @brief   Make a cache reclaimable
+ *
+ * @param   s   The shrinker of the cache, which must stay valid until it is
+ *              unregistered
+ */
+void shrinker_register(struct shrinker *s);
+
+/**
+ * @brief   Stop asking a cache for pages
+ *
+ * @param   s   A shrinker passed to shrinker_register
+ */
+void shrinker_unregister(struct shrinker *s);
+
+/**
+ * @brief   Ask the registered caches to release pages
+ * @details Each cache is asked for a share of the pages proportional to how
+ *          many it can release. Calls made while a reclaim is already running
+ *          do nothing, so a cache may free memory from its scan callback.
+ *
+ * @param   nr  Number of pages wanted
+ * @return  The number of pages released
+ */
+uint32_t shrinker_shrink(uint32_t nr);
+
+/**
+ * @brief   Free pages below which the page allocator reclaims cache pages
+ * @details The watermarks scale with the amount of memory: the low one is
+ *          1/64 of it, but at least 32 pages, and the high one twice that.
+ */
+uint32_t shrinker_watermark_low();
+
+/**
+ * @brief   Free pages the reclaimers bring memory back up to
+ */
+uint32_t shrinker_watermark_high();
+
+/**
+ * @brief   Release cache pages while free memory is below the high watermark
+ * @details Releases at most SHRINKER_BATCH pages per call, so that it can run
+ *          from the idle loop without delaying a process that becomes ready.
+ *
+ * @return  The number of pages released, 0 when there is enough headroom or
+ *          nothing left to release
+ */
+uint32_t shrinker_balance();
+
+/**
+ * @brief   Print the reclaimable pages of every cache on the console
+ */
+void shrinker_report();
+
+#endif
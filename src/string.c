@@ -8,9 +8,26 @@ See the file LICENSE for details.
 #include "process.h"
 #include "console.h"
 #include "kerneltypes.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "memorylayout.h"   // PROCESS_ENTRY_POINT
 
 #include "stdarg.h"
 
+// SSE2 copies move 64 bytes per iteration, in chunks with interrupts off
+// and the FPU taken from its owner
+#define STRING_SSE2_MIN     256
+#define STRING_SSE2_CHUNK   4096
+
+// Below this, rep movsb does not pay for its startup even with ERMSB
+#define STRING_ERMSB_MIN    64
+
+static void memcpy_words(void *vd, const void *vs, unsigned length);
+static void memset_words(void *vd, char value, unsigned length);
+
+static void (*memcpy_variant)(void *, const void *, unsigned) = memcpy_words;
+static void (*memset_variant)(void *, char, unsigned) = memset_words;
+
 void strcpy(char *d, const char *s) {
     while (*s) {
         *d++ = *s++;
@@ -51,12 +68,28 @@ int strncmp(const char *a, const char *b, unsigned length) {
 }
 
 unsigned strlen(const char *s) {
-    unsigned len = 0;
-    while (*s) {
-        len++;
-        s++;
+    const char *p = s;
+
+    // Go byte by byte up to a word boundary, so that reading whole words
+    // never crosses into the next page
+    while ((uint32_t)p & 3) {
+        if (!*p) {
+            return p - s;
+        }
+        p++;
+    }
+
+    // A word holds a zero byte exactly when this expression is not zero
+    const uint32_t *w = (const uint32_t *)p;
+    while (!((*w - 0x01010101) & ~*w & 0x80808080)) {
+        w++;
+    }
+
+    p = (const char *)w;
+    while (*p) {
+        p++;
     }
-    return len;
+    return p - s;
 }
 
 const char *strchr(const char *s, char ch) {
@@ -101,7 +134,7 @@ char *strtok(char *s, const char *delim) {
     return word;
 }
 
-void memset(void *vd, char value, unsigned length) {
+static void memset_bytes(void *vd, char value, unsigned length) {
     char *d = vd;
     while (length) {
         *d = value;
@@ -110,7 +143,7 @@ void memset(void *vd, char value, unsigned length) {
     }
 }
 
-void memcpy(void *vd, const void *vs, unsigned length) {
+static void memcpy_bytes(void *vd, const void *vs, unsigned length) {
     char *d = vd;
     const char *s = vs;
     while (length) {
@@ -121,6 +154,265 @@ void memcpy(void *vd, const void *vs, unsigned length) {
     }
 }
 
+static void memset_words(void *vd, char value, unsigned length) {
+    char *d = vd;
+    uint32_t word = (uint8_t)value * 0x01010101;
+
+    if (length >= 16) {
+        // Align the destination, then store whole words
+        unsigned head = -(uint32_t)d & 3;
+        unsigned words = (length - head) / 4;
+        length = (length - head) & 3;
+        asm volatile("cld\n\t"
+                     "rep stosb\n\t"
+                     "movl %3, %%ecx\n\t"
+                     "rep stosl"
+                     : "+D"(d), "+c"(head)
+                     : "a"(word), "r"(words)
+                     : "memory");
+    }
+
+    while (length >= 4) {
+        *(uint32_t *)d = word;
+        d += 4;
+        length -= 4;
+    }
+    if (length & 2) {
+        *(uint16_t *)d = word;
+        d += 2;
+    }
+    if (length & 1) {
+        *d = value;
+    }
+}
+
+static void memcpy_words(void *vd, const void *vs, unsigned length) {
+    char *d = vd;
+    const char *s = vs;
+
+    if (length >= 16) {
+        // Align the destination, then move whole words
+        unsigned head = -(uint32_t)d & 3;
+        unsigned words = (length - head) / 4;
+        length = (length - head) & 3;
+        asm volatile("cld\n\t"
+                     "rep movsb\n\t"
+                     "movl %3, %%ecx\n\t"
+                     "rep movsl"
+                     : "+D"(d), "+S"(s), "+c"(head)
+                     : "r"(words)
+                     : "memory");
+    }
+
+    while (length >= 4) {
+        *(uint32_t *)d = *(const uint32_t *)s;
+        d += 4;
+        s += 4;
+        length -= 4;
+    }
+    if (length & 2) {
+        *(uint16_t *)d = *(const uint16_t *)s;
+        d += 2;
+        s += 2;
+    }
+    if (length & 1) {
+        *d = *s;
+    }
+}
+
+static void memset_ermsb(void *vd, char value, unsigned length) {
+    if (length < STRING_ERMSB_MIN) {
+        memset_words(vd, value, length);
+        return;
+    }
+    asm volatile("cld\n\t"
+                 "rep stosb"
+                 : "+D"(vd), "+c"(length)
+                 : "a"(value)
+                 : "memory");
+}
+
+static void memcpy_ermsb(void *vd, const void *vs, unsigned length) {
+    if (length < STRING_ERMSB_MIN) {
+        memcpy_words(vd, vs, length);
+        return;
+    }
+    asm volatile("cld\n\t"
+                 "rep movsb"
+                 : "+D"(vd), "+S"(vs), "+c"(length)
+                 :
+                 : "memory");
+}
+
+// The xmm registers may hold a process's state, so they are only used inside
+// fpu_kernel_begin and _end, and only on kernel space, which never faults.
+// A fault could sleep and let another process take the registers.
+static int string_sse2_usable(const void *a, const void *b, unsigned length) {
+    return length >= STRING_SSE2_MIN &&
+           (uint32_t)a + length <= PROCESS_ENTRY_POINT &&
+           (uint32_t)b + length <= PROCESS_ENTRY_POINT;
+}
+
+static void memset_sse2(void *vd, char value, unsigned length) {
+    char *d = vd;
+
+    if (!string_sse2_usable(d, d, length)) {
+        memset_words(d, value, length);
+        return;
+    }
+
+    // Align the destination for movdqa
+    unsigned head = -(uint32_t)d & 15;
+    memset_words(d, value, head);
+    d += head;
+    length -= head;
+
+    uint32_t word = (uint8_t)value * 0x01010101;
+    while (length >= 64) {
+        unsigned chunk = length < STRING_SSE2_CHUNK ? length & ~63 :
+                                                      STRING_SSE2_CHUNK;
+        unsigned blocks = chunk / 64;
+        unsigned flags = fpu_kernel_begin();
+        asm volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n"
+                     "1:\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm0, 16(%0)\n\t"
+                     "movdqa %%xmm0, 32(%0)\n\t"
+                     "movdqa %%xmm0, 48(%0)\n\t"
+                     "addl $64, %0\n\t"
+                     "decl %1\n\t"
+                     "jnz 1b"
+                     : "+r"(d), "+r"(blocks)
+                     : "r"(word)
+                     : "memory", "cc");
+        fpu_kernel_end(flags);
+        length -= chunk;
+    }
+    memset_words(d, value, length);
+}
+
+static void memcpy_sse2(void *vd, const void *vs, unsigned length) {
+    char *d = vd;
+    const char *s = vs;
+
+    if (!string_sse2_usable(d, s, length)) {
+        memcpy_words(d, s, length);
+        return;
+    }
+
+    // Align the destination for movdqa; the source may stay unaligned
+    unsigned head = -(uint32_t)d & 15;
+    memcpy_words(d, s, head);
+    d += head;
+    s += head;
+    length -= head;
+
+    while (length >= 64) {
+        unsigned chunk = length < STRING_SSE2_CHUNK ? length & ~63 :
+                                                      STRING_SSE2_CHUNK;
+        unsigned blocks = chunk / 64;
+        unsigned flags = fpu_kernel_begin();
+        // All four loads come before the stores, which keeps forward copies
+        // of overlapping buffers correct for memmove
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)\n\t"
+                     "addl $64, %1\n\t"
+                     "addl $64, %0\n\t"
+                     "decl %2\n\t"
+                     "jnz 1b"
+                     : "+r"(d), "+r"(s), "+r"(blocks)
+                     :
+                     : "memory", "cc");
+        fpu_kernel_end(flags);
+        length -= chunk;
+    }
+    memcpy_words(d, s, length);
+}
+
+void string_init() {
+    if (cpu_has(CPU_FEATURE_ERMSB)) {
+        string_select(STRING_VARIANT_ERMSB);
+    } else if (cpu_has(CPU_FEATURE_SSE2)) {
+        string_select(STRING_VARIANT_SSE2);
+    } else {
+        string_select(STRING_VARIANT_WORDS);
+    }
+}
+
+int string_select(int variant) {
+    switch (variant) {
+    case STRING_VARIANT_BYTES:
+        memcpy_variant = memcpy_bytes;
+        memset_variant = memset_bytes;
+        return 1;
+    case STRING_VARIANT_WORDS:
+        memcpy_variant = memcpy_words;
+        memset_variant = memset_words;
+        return 1;
+    case STRING_VARIANT_SSE2:
+        if (!cpu_has(CPU_FEATURE_SSE2)) {
+            return 0;
+        }
+        memcpy_variant = memcpy_sse2;
+        memset_variant = memset_sse2;
+        return 1;
+    case STRING_VARIANT_ERMSB:
+        if (!cpu_has(CPU_FEATURE_ERMSB)) {
+            return 0;
+        }
+        memcpy_variant = memcpy_ermsb;
+        memset_variant = memset_ermsb;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void memset(void *vd, char value, unsigned length) {
+    memset_variant(vd, value, length);
+}
+
+void memcpy(void *vd, const void *vs, unsigned length) {
+    memcpy_variant(vd, vs, length);
+}
+
+void memmove(void *vd, const void *vs, unsigned length) {
+    char *d = vd;
+    const char *s = vs;
+
+    // Every variant copies forward, which is right unless the destination
+    // starts inside the source
+    if (d <= s || d >= s + length) {
+        memcpy_variant(d, s, length);
+        return;
+    }
+
+    // Copy backward: the odd bytes at the end, then whole words
+    d += length;
+    s += length;
+    while (length & 3) {
+        *--d = *--s;
+        length--;
+    }
+    unsigned words = length / 4;
+    d -= 4;
+    s -= 4;
+    asm volatile("std\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D"(d), "+S"(s), "+c"(words)
+                 :
+                 : "memory");
+}
+
 static void printf_putchar(char c) {
     console_write(0, &c, 1, 0);
 }
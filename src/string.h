@@ -19,6 +19,34 @@ const char *strchr(const char *s, char ch);
 void memset(void *d, char value, unsigned length);
 void memcpy(void *d, const void *s, unsigned length);
 
+/**
+ * @brief Copy memory between buffers that may overlap
+ * @param d The destination buffer
+ * @param s The source buffer
+ * @param length The number of bytes to copy
+ */
+void memmove(void *d, const void *s, unsigned length);
+
+// Implementations of memcpy and memset, see string_select
+#define STRING_VARIANT_BYTES    0   // one byte per iteration
+#define STRING_VARIANT_WORDS    1   // rep movsl and rep stosl
+#define STRING_VARIANT_SSE2     2   // 64 bytes per iteration in xmm registers
+#define STRING_VARIANT_ERMSB    3   // rep movsb and rep stosb
+
+/**
+ * @brief Pick the fastest memcpy and memset for the processor
+ * @details Until this is called, the word variant is used. It must come
+ * after cpu_init.
+ */
+void string_init();
+
+/**
+ * @brief Switch memcpy and memset to a given implementation
+ * @param variant One of the STRING_VARIANT_ values
+ * @return 1 if the variant is in use; 0 if the processor lacks it
+ */
+int string_select(int variant);
+
 void printf(const char *s, ...);
 
 /**
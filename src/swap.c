@@ -0,0 +1,291 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "swap.h"
+#include "ata.h"
+#include "bitmap.h"
+#include "console.h"
+#include "interrupt.h"
+#include "memory_raw.h"
+#include "memorylayout.h"
+#include "mutex.h"
+#include "pagetable.h"
+#include "workqueue.h"
+
+#define BLOCKS_PER_PAGE (PAGE_SIZE / ATA_BLOCKSIZE)
+
+// Bit n is set when slot n is free
+static uint32_t *swap_free_map = 0;
+static uint32_t swap_slots = 0;
+
+// Held while pages are written out, so that a page being written is not
+// read back in before it reaches the disk
+static struct mutex swap_mutex = MUTEX_INIT;
+
+// Position of the clock hand
+static struct process *swap_hand_process = 0;
+static uint32_t swap_hand_vaddr = PROCESS_ENTRY_POINT;
+
+// Dirty victims waiting to be written to consecutive slots
+struct swap_victim {
+    struct process *p;
+    uint32_t vaddr;
+    uint32_t frame;
+};
+
+static struct swap_victim swap_batch[SWAP_BATCH];
+static int swap_batch_count = 0;
+static uint32_t swap_batch_slot = 0;    // slot of swap_batch[0]
+
+// Reclaim run by the worker thread for callers that cannot sleep, and the
+// processes waiting for it to finish
+static void swap_reclaim_work(void *arg);
+static struct work swap_work = WORK_INIT(swap_reclaim_work, 0);
+static struct list swap_waiters = LIST_INIT;
+static int swap_work_freed = 0;
+
+static uint32_t swap_block_for_slot(uint32_t slot) {
+    return SWAP_FIRST_BLOCK + slot * BLOCKS_PER_PAGE;
+}
+
+void swap_init() {
+    int nblocks, blocksize;
+    if (!ata_geometry(SWAP_ATA_UNIT, &nblocks, &blocksize) ||
+        blocksize != ATA_BLOCKSIZE || nblocks <= SWAP_FIRST_BLOCK) {
+        console_printf("swap: no disk on ata unit %d, swapping disabled\n",
+                       SWAP_ATA_UNIT);
+        return;
+    }
+
+    swap_slots = (nblocks - SWAP_FIRST_BLOCK) / BLOCKS_PER_PAGE;
+    if (swap_slots > SWAP_MAX_SLOTS) {
+        swap_slots = SWAP_MAX_SLOTS;
+    }
+
+    swap_free_map = memory_alloc_page(1);
+    uint32_t i;
+    for (i = 0; i < swap_slots; i++) {
+        bitmap_set(swap_free_map, i);
+    }
+
+    console_printf("swap: %d MB on ata unit %d\n",
+                   swap_slots * PAGE_SIZE / MEGA, SWAP_ATA_UNIT);
+}
+
+void swap_free(uint32_t slot) {
+    if (slot < swap_slots) {
+        bitmap_set(swap_free_map, slot);
+    }
+}
+
+// Write the batch to its consecutive slots, one disk command per page with
+// no other transfer in between, then free its frames. If the write fails,
+// the pages are mapped back in and their slots released.
+static int swap_flush_batch() {
+    int i;
+    int count = swap_batch_count;
+    void *frames[SWAP_BATCH];
+
+    if (count == 0) {
+        return 0;
+    }
+    swap_batch_count = 0;
+
+    for (i = 0; i < count; i++) {
+        frames[i] = pagetable_kmap(swap_batch[i].frame);
+    }
+
+    int written = ata_write_vector(SWAP_ATA_UNIT, frames, count, BLOCKS_PER_PAGE,
+                                   swap_block_for_slot(swap_batch_slot));
+
+    for (i = 0; i < count; i++) {
+        pagetable_kunmap(frames[i]);
+    }
+
+    int freed = 0;
+    for (i = 0; i < count; i++) {
+        struct swap_victim *v = &swap_batch[i];
+        if (written) {
+            memory_free_frame(v->frame);
+            freed++;
+        } else {
+            swap_free(swap_batch_slot + i);
+            if (v->p) {
+                pagetable_swap_in(v->p->pagetable, v->vaddr, v->frame);
+            } else {
+                // The owner exited while the batch was pending
+                memory_free_frame(v->frame);
+                freed++;
+            }
+        }
+    }
+    if (!written) {
+        console_printf("swap: cannot write %d pages to slot %d\n", count,
+                       swap_batch_slot);
+    }
+    return freed;
+}
+
+// Queue a dirty victim for writing, and mark it swapped out. Returns the
+// number of frames freed by flushing the batch, or -1 if swap is full.
+static int swap_queue_victim(struct process *p, uint32_t vaddr, uint32_t frame) {
+    int32_t slot = bitmap_first_set(swap_free_map, BITMAP_CELLS(swap_slots));
+    if (slot < 0) {
+        return -1;
+    }
+
+    bitmap_clear(swap_free_map, slot);
+
+    // Only consecutive slots can go out in the same write
+    int freed = 0;
+    if (swap_batch_count > 0 && slot != swap_batch_slot + swap_batch_count) {
+        freed = swap_flush_batch();
+        // The write slept: p may have exited, or unmapped the page and let
+        // the frame go to someone else
+        unsigned still;
+        if (swap_hand_process != p ||
+            !pagetable_getframe(p->pagetable, vaddr, &still) ||
+            still != frame) {
+            swap_free(slot);
+            return freed;
+        }
+    }
+    if (swap_batch_count == 0) {
+        swap_batch_slot = slot;
+    }
+
+    pagetable_swap_out(p->pagetable, vaddr, slot);
+
+    struct swap_victim *v = &swap_batch[swap_batch_count++];
+    v->p = p;
+    v->vaddr = vaddr;
+    v->frame = frame;
+
+    if (swap_batch_count == SWAP_BATCH) {
+        freed += swap_flush_batch();
+    }
+    return freed;
+}
+
+int swap_reclaim() {
+    if (!swap_slots || !current || !process_all) {
+        return 0;
+    }
+
+    mutex_lock(&swap_mutex);
+
+    int freed = 0;
+    int laps = 0;
+
+    // Two laps are enough: the first one clears every accessed bit
+    while (freed + swap_batch_count < SWAP_BATCH && laps < 2) {
+        if (!swap_hand_process) {
+            swap_hand_process = process_all;
+            swap_hand_vaddr = PROCESS_ENTRY_POINT;
+            laps++;
+        }
+        struct process *p = swap_hand_process;
+
+        unsigned frame;
+        int victim = pagetable_clock_scan(p->pagetable, &swap_hand_vaddr, &frame);
+        if (!victim) {
+            swap_hand_process = p->all_next;
+            swap_hand_vaddr = PROCESS_ENTRY_POINT;
+            continue;
+        }
+
+        if (victim == PAGETABLE_PAGE_CLEAN) {
+            // Nothing to save: the next fault maps a zeroed page again
+            pagetable_unmap(p->pagetable, swap_hand_vaddr);
+            memory_free_frame(frame);
+            p->number_of_pages_using--;
+            freed++;
+        } else {
+            int result = swap_queue_victim(p, swap_hand_vaddr, frame);
+            if (result < 0) {
+                break;
+            }
+            freed += result;
+        }
+
+        // Writing the batch may have slept, and p may have exited meanwhile,
+        // in which case the hand was already moved on
+        if (swap_hand_process == p) {
+            swap_hand_vaddr += PAGE_SIZE;
+            if (swap_hand_vaddr == 0) {
+                swap_hand_process = p->all_next;
+                swap_hand_vaddr = PROCESS_ENTRY_POINT;
+            }
+        }
+    }
+
+    freed += swap_flush_batch();
+
+    mutex_unlock(&swap_mutex);
+    return freed;
+}
+
+static void swap_reclaim_work(void *arg) {
+    int freed = swap_reclaim();
+    unsigned flags = interrupt_save();
+    swap_work_freed = freed;
+    process_wakeup_all(&swap_waiters);
+    interrupt_restore(flags);
+}
+
+void swap_reclaim_later() {
+    if (swap_slots) {
+        work_schedule(&swap_work);
+    }
+}
+
+int swap_reclaim_wait() {
+    if (!swap_slots || !current) {
+        return 0;
+    }
+    // Queue up before the work can run, so its wakeup is not missed
+    interrupt_block();
+    work_schedule(&swap_work);
+    process_wait(&swap_waiters);
+    return swap_work_freed;
+}
+
+int swap_in(struct process *p, uint32_t vaddr, uint32_t slot) {
+    // Allocate first: allocating may itself need swap_mutex
+    uint32_t frame = memory_alloc_frame(0);
+    if (!frame) {
+        return 0;
+    }
+
+    mutex_lock(&swap_mutex);
+    void *addr = pagetable_kmap(frame);
+    int read = ata_read(SWAP_ATA_UNIT, addr, BLOCKS_PER_PAGE,
+                        swap_block_for_slot(slot));
+    pagetable_kunmap(addr);
+    mutex_unlock(&swap_mutex);
+
+    if (!read) {
+        memory_free_frame(frame);
+        return 0;
+    }
+
+    pagetable_swap_in(p->pagetable, vaddr, frame);
+    swap_free(slot);
+    return 1;
+}
+
+void swap_forget_process(struct process *p) {
+    int i;
+    if (swap_hand_process == p) {
+        swap_hand_process = p->all_next;
+        swap_hand_vaddr = PROCESS_ENTRY_POINT;
+    }
+    for (i = 0; i < swap_batch_count; i++) {
+        if (swap_batch[i].p == p) {
+            swap_batch[i].p = 0;
+        }
+    }
+}
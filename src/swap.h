@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "kerneltypes.h"
+#include "process.h"
+
+#define SWAP_ATA_UNIT   0
+#define SWAP_FIRST_BLOCK 2048   // leave the first MB of the disk alone
+#define SWAP_MAX_SLOTS  (PAGE_SIZE * 8)
+#define SWAP_BATCH      8       // pages freed per reclaim
+
+/**
+ * @brief   Set up the swap area
+ * @details Uses the ATA disk on SWAP_ATA_UNIT, from SWAP_FIRST_BLOCK on, as
+ *          an array of page sized slots. Swapping stays disabled if there is
+ *          no such disk. Must be called after ata_init.
+ */
+void swap_init();
+
+/**
+ * @brief   Free frames by evicting user pages
+ * @details Runs the second-chance clock over the user pages of every process
+ *          until SWAP_BATCH victims are found. Victims still holding the zeros
+ *          they were mapped with are simply dropped, to be faulted in afresh;
+ *          the others are written to consecutive swap slots, one disk
+ *          command per page, with the disk held for the whole batch.
+ *
+ * @return  The number of frames freed, 0 if swapping is disabled or nothing
+ *          could be evicted
+ */
+int swap_reclaim();
+
+/**
+ * @brief   Have the worker thread run swap_reclaim
+ * @details For callers that cannot sleep, such as interrupt handlers and
+ *          allocations made with interrupts blocked. Returns at once.
+ */
+void swap_reclaim_later();
+
+/**
+ * @brief   Wait for the worker thread to run swap_reclaim
+ * @details Sleeps, so it must not be called from an interrupt handler or
+ *          with locks held. The page fault handler uses it to retry a fault
+ *          that ran out of frames.
+ *
+ * @return  The number of frames the worker freed
+ */
+int swap_reclaim_wait();
+
+/**
+ * @brief   Read a swapped out page back in
+ *
+ * @param   p       The process owning the page
+ * @param   vaddr   The page's virtual address
+ * @param   slot    The swap slot recorded in the page's entry
+ * @return  1 on success, 0 on failure
+ */
+int swap_in(struct process *p, uint32_t vaddr, uint32_t slot);
+
+/**
+ * @brief   Release a swap slot whose page is no longer needed
+ *
+ * @param   slot    The slot to release
+ */
+void swap_free(uint32_t slot);
+
+/**
+ * @brief   Forget a process that is about to be deleted
+ * @details Moves the clock hand off the process and drops its pages from the
+ *          batch being written.
+ *
+ * @param   p   The exiting process
+ */
+void swap_forget_process(struct process *p);
+
+#endif
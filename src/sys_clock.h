@@ -9,16 +9,90 @@ See the file LICENSE for details.
 
 #include "kerneltypes.h"
 #include "sys_clock_struct.h"
+#include "memorylayout.h"
+
+#define CLOCK_PAGE ((const volatile struct clock_page *)PROCESS_CLOCK_PAGE)
+
+/**
+ * @brief Reads the time since boot in nanoseconds
+ * @details Reads the clock page the kernel shares with every process, so no
+ * system call is made. With a TSC the result has cycle resolution, and tick
+ * resolution otherwise.
+ *
+ * @return The time since boot in nanoseconds
+ */
+static inline uint64_t read_clock_ns() {
+    uint32_t sequence;
+    uint64_t ns;
+    do {
+        sequence = CLOCK_PAGE->sequence;
+        ns = CLOCK_PAGE->base_ns;
+        if (CLOCK_PAGE->tsc_mult) {
+            uint64_t tsc;
+            asm volatile("rdtsc" : "=A"(tsc));
+            ns += ((tsc - CLOCK_PAGE->base_tsc) * CLOCK_PAGE->tsc_mult +
+                   CLOCK_PAGE->base_frac) >> CLOCK_PAGE->tsc_shift;
+        }
+    } while ((sequence & 1) || sequence != CLOCK_PAGE->sequence);
+    return ns;
+}
+
+/**
+ * @brief Reads the calendar time
+ * @details Reads the clock page, which the kernel updates every second from
+ * the RTC, so unlike read_rtc no system call is made.
+ *
+ * @param t The returned calendar time.
+ */
+static inline void read_wall_clock(struct rtc_time *t) {
+    uint32_t sequence;
+    do {
+        sequence = CLOCK_PAGE->sequence;
+        t->second = CLOCK_PAGE->wall.second;
+        t->minute = CLOCK_PAGE->wall.minute;
+        t->hour = CLOCK_PAGE->wall.hour;
+        t->day = CLOCK_PAGE->wall.day;
+        t->month = CLOCK_PAGE->wall.month;
+        t->year = CLOCK_PAGE->wall.year;
+    } while ((sequence & 1) || sequence != CLOCK_PAGE->sequence);
+}
+
+/**
+ * @brief Subtracts two times
+ * @details The same as clock_diff in the kernel.
+ *
+ * @param start The earlier time
+ * @param stop The later time
+ * @return The time from start to stop
+ */
+static inline clock_t clock_elapsed(clock_t start, clock_t stop) {
+    clock_t result;
+    if (stop.millis < start.millis) {
+        stop.millis += 1000;
+        stop.seconds -= 1;
+    }
+    result.seconds = stop.seconds - start.seconds;
+    result.millis = stop.millis - start.millis;
+    return result;
+}
 
 /**
  * @brief Reads clock info
- * @details Reads clock info into a user allocated clock_t struct.
+ * @details Reads the time since boot into a user allocated clock_t struct,
+ * from the clock page rather than with a system call.
  *
  * @param clock The returned clock info.
  * @return 0
  */
 static inline int32_t read_clock(clock_t *clock) {
-    return syscall(SYSCALL_clock_read, (uint32_t)clock, 0, 0, 0, 0);
+    uint64_t ns = read_clock_ns();
+    uint32_t seconds, rem;
+    // 64 by 32 bit division, without a runtime library
+    asm("divl %4" : "=a"(seconds), "=d"(rem)
+        : "a"((uint32_t)ns), "d"((uint32_t)(ns >> 32)), "rm"(1000000000));
+    clock->seconds = seconds;
+    clock->millis = rem / 1000000;
+    return 0;
 }
 
 /**
@@ -7,10 +7,35 @@ See the file LICENSE for details.
 #ifndef SYS_CLOCK_STRUCT_H
 #define SYS_CLOCK_STRUCT_H
 
+#include "sys_rtc_struct.h"
+
 typedef struct {
     uint32_t seconds;
     uint32_t millis;
 } clock_t;
 
+/*
+ * The kernel keeps the time in a page mapped read-only at PROCESS_CLOCK_PAGE
+ * in every process. The sequence is odd while the kernel updates the page,
+ * and changes with every update, so a reader retries until it sees the same
+ * even sequence before and after reading.
+ *
+ * The time since boot is base_ns, plus the TSC cycles since base_tsc scaled
+ * by (cycles * tsc_mult + base_frac) >> tsc_shift. Without a TSC, tsc_mult
+ * is 0, and base_ns moves on every tick.
+ */
+struct clock_page {
+    uint32_t sequence;
+    uint32_t hz;            // ticks per second
+    uint32_t ticks;         // ticks since boot
+    uint32_t tsc_khz;       // 0 without a TSC
+    uint32_t tsc_mult;
+    uint32_t tsc_shift;
+    uint32_t base_frac;
+    uint64_t base_tsc;
+    uint64_t base_ns;
+    struct rtc_time wall;   // calendar time, updated every second
+};
+
 #endif
 
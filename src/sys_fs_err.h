@@ -13,7 +13,7 @@ See the file LICENSE for details.
 #define ERR_FD_OOR -1   // file descriptor is out of range
 #define ERR_NO_ALLOWANCE -2    // process does not have an allowance to use this file
 #define ERR_OPEN_CONFLICT -3   // opening of file refused due to another process having the file open
-#define ERR_FDS_EXCEEDED -4    // process has too many open files and cannot open more
+#define ERR_FDS_EXCEEDED -4    // the file descriptor table of the process could not grow to open more files
 #define ERR_BAD_MODE -5    // mode specified is not a legal mode string
 #define ERR_BAD_PATH -6    // path does not start with /X/, where X is in the inclusive range 0-3, which is a requisite for Nunya OS
 #define ERR_KERNEL_OPEN_FAIL -7   // the kernel could not create the structures it needed to track the file if opened
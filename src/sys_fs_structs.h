@@ -1,7 +1,6 @@
 #ifndef FS_SYS_STRUCTS_H
 #define FS_SYS_STRUCTS_H
 
-#define PROCESS_MAX_OPEN_FILES 64
 #define MAX_PATH_LENGTH 256
 
 struct fs_allowance {
@@ -12,6 +11,7 @@ struct fs_allowance {
 
 struct fd {
     bool is_open;
+    uint8_t access;  // modes granted by the allowance check at open
     struct fs_agnostic_file *ptr;
 };
 
@@ -8,6 +8,7 @@ See the file LICENSE for details.
 #define SYS_MEMORY_H
 
 #include "kerneltypes.h"
+#include "sys_memory_flags.h"
 
 /**
  * @brief   Returns the number of pages the current process is using.
@@ -48,5 +49,70 @@ static inline int32_t capability_set_max_memory(uint32_t identifier, uint32_t pa
     return syscall(SYSCALL_capability_set_max_memory, identifier, pages, 0, 0, 0);
 }
 
+/**
+ * @brief   Maps a range of a file or anonymous memory into the address space
+ *          of the process.
+ * @details With MMAP_FILE, maps length bytes of the file open for reading on
+ *          fd, starting at offset, read-only. The data is not copied: pages
+ *          are filled on first access and shared with every other process
+ *          mapping the same file. With MMAP_ANON, reserves length bytes of
+ *          zero-filled read-write memory, and fd and offset are ignored.
+ *          Either way, each page counts toward the process' memory allocation
+ *          only once touched.
+ *
+ * @param   length The number of bytes to map.
+ * @param   flags MMAP_FILE or MMAP_ANON.
+ * @param   fd The file descriptor of the file to map.
+ * @param   offset The offset into the file, a multiple of the page size.
+ *
+ * @return  The address of the mapping, or 0 on failure.
+ */
+static inline void *mmap(uint32_t length, uint32_t flags, uint32_t fd, uint32_t offset) {
+    return (void *)syscall(SYSCALL_mmap, length, flags, fd, offset, 0);
+}
+
+/**
+ * @brief   Removes a mapping created by mmap.
+ * @details The pages of the mapping are released and no longer count toward
+ *          the process' memory allocation.
+ *
+ * @param   addr The address returned by mmap.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+static inline int32_t munmap(void *addr) {
+    return syscall(SYSCALL_munmap, (uint32_t)addr, 0, 0, 0, 0);
+}
+
+/**
+ * @brief   Moves the end of the heap, which starts right after the program.
+ * @details Growing the heap only reserves addresses; pages are allocated when
+ *          first touched. Shrinking it releases the pages above the new end.
+ *          The heap can not shrink below its initial size.
+ *
+ * @param   addr The new end of the heap, or 0 to query the current one.
+ *
+ * @return  The end of the heap after the call, unchanged on failure.
+ */
+static inline void *brk(void *addr) {
+    return (void *)syscall(SYSCALL_brk, (uint32_t)addr, 0, 0, 0, 0);
+}
+
+/**
+ * @brief   Gives the kernel a hint about the use of a range of memory.
+ * @details With MADV_WILLNEED, every page of the range is mapped right away,
+ *          as far as the process' memory allocation allows, so that filling
+ *          a large buffer does not take one page fault per page.
+ *
+ * @param   addr The start of the range, inside the heap, stack or a mapping.
+ * @param   length The length of the range in bytes.
+ * @param   advice Must be MADV_WILLNEED.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+static inline int32_t madvise(void *addr, uint32_t length, uint32_t advice) {
+    return syscall(SYSCALL_madvise, (uint32_t)addr, length, advice, 0, 0);
+}
+
 
 #endif
@@ -0,0 +1,17 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef SYS_MEMORY_FLAGS_H
+#define SYS_MEMORY_FLAGS_H
+
+// Flags accepted by the mmap syscall
+#define MMAP_FILE 1     // map a read-only range of a file opened for reading
+#define MMAP_ANON 2     // reserve zero-filled memory, allocated on first touch
+
+// Advice accepted by the madvise syscall
+#define MADV_WILLNEED 1 // map the whole range now instead of on first touch
+
+#endif
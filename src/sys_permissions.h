@@ -36,4 +36,19 @@ static inline void permissions_capability_delete(uint32_t identifier) {
     syscall(SYSCALL_capability_delete, identifier, 0, 0, 0, 0);
 }
 
+/**
+ * @brief   Sets the scheduling priority of processes run with a capability
+ * @details The process starts at this priority, and can not raise its own
+ *          priority above it with setpriority. A process can not give a
+ *          capability a higher priority than its own limit.
+ *
+ * @param   identifier The identifier of the capability to change.
+ * @param   priority The priority, from 0, which runs first, to 7.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+static inline int32_t capability_set_priority(uint32_t identifier, uint32_t priority) {
+    return syscall(SYSCALL_capability_set_priority, identifier, priority, 0, 0, 0);
+}
+
 #endif
@@ -35,6 +35,21 @@ static inline int32_t yield() {
     return syscall(SYSCALL_yield, 0, 0, 0, 0, 0);
 }
 
+/**
+ * @brief   Changes the scheduling priority of the current process.
+ * @details Processes at priority 0 run first. A process that uses up its
+ *          time slices sinks below its priority for a while, and goes back
+ *          to it when it waits for input. The priority can not be raised
+ *          above the one of the capability the process was run with.
+ *
+ * @param   priority The new priority, from 0 to 7.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+static inline int32_t setpriority(uint32_t priority) {
+    return syscall(SYSCALL_setpriority, priority, 0, 0, 0, 0);
+}
+
 /**
  * @brief   Creates and begins execution of a new process.
  * @details Loads a new process into memory as a child of the current process,
@@ -38,17 +38,29 @@ int32_t syscall_handler(uint32_t n, uint32_t a, uint32_t b, uint32_t c,
             return sys_sleep(a);
         case SYSCALL_rtc_read:
             return sys_rtc_read((struct rtc_time *)a);
+        case SYSCALL_setpriority:
+            return sys_setpriority(a);
         case SYSCALL_capability_create:
             return sys_capability_create();
         case SYSCALL_capability_delete:
             sys_capability_delete(a);
             return 0;
+        case SYSCALL_capability_set_priority:
+            return sys_capability_set_priority(a, b);
         case SYSCALL_memory_current_usage:
             return sys_current_memory_usage();
         case SYSCALL_capability_set_max_memory:
             return sys_capability_set_max_memory(a, b);
         case SYSCALL_memory_max:
             return sys_max_memory();
+        case SYSCALL_mmap:
+            return sys_mmap(a, b, c, d);
+        case SYSCALL_munmap:
+            return sys_munmap(a);
+        case SYSCALL_brk:
+            return sys_brk(a);
+        case SYSCALL_madvise:
+            return sys_madvise(a, b, c);
         case SYSCALL_open:
             return sys_fs_open((const char *)a, (const char *)b);
         case SYSCALL_close:
@@ -7,6 +7,8 @@ See the file LICENSE for details.
 #include "syscall_handler_memory.h"
 #include "process.h"
 #include "permissions_capabilities.h"
+#include "mmap.h"
+#include "sys_memory_flags.h"
 
 int32_t sys_current_memory_usage() {
     return current->number_of_pages_using;
@@ -36,4 +38,28 @@ int32_t sys_capability_set_max_memory(uint32_t identifier, uint32_t pages) {
 
     c->max_number_of_pages = pages;
     return 0;
-}
\ No newline at end of file
+}
+
+int32_t sys_mmap(uint32_t length, uint32_t flags, uint32_t fd, uint32_t offset) {
+    if (flags == MMAP_FILE) {
+        return mmap_file(current, fd, offset, length);
+    } else if (flags == MMAP_ANON) {
+        return mmap_anon(current, length);
+    }
+    return 0;
+}
+
+int32_t sys_munmap(uint32_t addr) {
+    return mmap_unmap(current, addr);
+}
+
+int32_t sys_brk(uint32_t addr) {
+    return mmap_brk(current, addr);
+}
+
+int32_t sys_madvise(uint32_t addr, uint32_t length, uint32_t advice) {
+    if (advice != MADV_WILLNEED) {
+        return -1;
+    }
+    return mmap_prefault(current, addr, length);
+}
@@ -43,4 +43,35 @@ int32_t sys_max_memory();
  */
 int32_t sys_capability_set_max_memory(uint32_t identifier, uint32_t pages);
 
+/**
+ * @brief   Maps a range of a file or anonymous memory into the current process.
+ * @details See mmap in sys_memory.h.
+ *
+ * @return  The address of the mapping, or 0 on failure.
+ */
+int32_t sys_mmap(uint32_t length, uint32_t flags, uint32_t fd, uint32_t offset);
+
+/**
+ * @brief   Removes a mapping from the current process.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+int32_t sys_munmap(uint32_t addr);
+
+/**
+ * @brief   Moves the end of the heap of the current process.
+ * @details See brk in sys_memory.h.
+ *
+ * @return  The break after the call.
+ */
+int32_t sys_brk(uint32_t addr);
+
+/**
+ * @brief   Gives a hint about the use of a range of the current process.
+ * @details See madvise in sys_memory.h.
+ *
+ * @return  0 on success, -1 on failure.
+ */
+int32_t sys_madvise(uint32_t addr, uint32_t length, uint32_t advice);
+
 #endif
\ No newline at end of file
@@ -12,6 +12,25 @@ int32_t sys_capability_create() {
     return create_permissions_capability();
 }
 
+int32_t sys_capability_set_priority(uint32_t identifier, uint32_t priority) {
+    if (!capability_owned_by_process(identifier, current)) {
+        return -1;
+    }
+
+    // A process can not hand out a higher priority than its own limit
+    if (priority >= PROCESS_PRIORITY_LEVELS ||
+        (int)priority < current->permissions->priority) {
+        return -1;
+    }
+
+    struct permissions_capability *c = capability_for_identifier(identifier);
+    if (c == 0) {
+        return -1;
+    }
+    c->priority = priority;
+    return 0;
+}
+
 void sys_capability_delete(uint32_t identifier) {
     if (capability_owned_by_process(identifier, current)) {
         delete_permissions_capability(identifier);
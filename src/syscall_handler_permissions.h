@@ -11,6 +11,7 @@ See the file LICENSE for details.
 
 int32_t sys_capability_create();
 void sys_capability_delete(uint32_t identifier);
+int32_t sys_capability_set_priority(uint32_t identifier, uint32_t priority);
 
 
 #endif
@@ -7,8 +7,10 @@ See the file LICENSE for details.
 #include "syscall_handler_process.h"
 #include "console.h"
 #include "iso.h"
-#include "memorylayout.h" // PROCESS_ENTRY_POINT
+#include "memorylayout.h" // PROCESS_ENTRY_POINT, PROCESS_STACK_MAX
 #include "permissions_capabilities.h"
+#include "fs.h"
+#include "pagetable.h"
 
 #define PROCESS_COPY_CHUNK PAGE_SIZE / 2 // Half a page
 
@@ -22,6 +24,10 @@ int32_t sys_yield() {
     return 0;
 }
 
+int32_t sys_setpriority(uint32_t priority) {
+    return process_set_priority(current, priority);
+}
+
 int32_t sys_run(const char *process_path, const uint32_t permissions_identifier, struct process *parent) {
 
     // Get the capability
@@ -46,12 +52,12 @@ int32_t sys_run(const char *process_path, const uint32_t permissions_identifier,
     // store the current number of pages used, so we can see how many the child uses
     int page_count_before_child = parent->number_of_pages_using;
 
-    // Create a new process(page, page)
-    struct process *child_proc = process_create(proc_file->data_length, PAGE_SIZE);
+    // Create a new process, whose stack grows on demand
+    struct process *child_proc = process_create(proc_file->data_length,
+                                                PROCESS_STACK_MAX);
 
-    if (child_proc <= 0) {
-        // free the intermediary memory we used
-        process_cleanup(child_proc);
+    if (!child_proc) {
+        // process_create already freed what it had built
         console_printf("Error creating process\n");
         return -1;
     }
@@ -60,6 +66,8 @@ int32_t sys_run(const char *process_path, const uint32_t permissions_identifier,
     struct process_permissions *child_permissions = permissions_from_identifier(permissions_identifier);
     child_proc->permissions = child_permissions;
     child_proc->parent = parent; // store the child's parent
+    process_set_priority(child_proc, child_permissions->priority);
+    fs_compile_allowances(child_proc);
 
     // transfer pages used count to child
     int child_pages_used = parent->number_of_pages_using - page_count_before_child;
@@ -95,8 +103,8 @@ int32_t sys_run(const char *process_path, const uint32_t permissions_identifier,
         return -1;
     }
 
-    // Create a real address to be gotten from the pagetable
-    uint32_t real_addr;
+    // The frame backing each chunk, which may not be direct mapped
+    uint32_t frame;
 
     int amount_copied = 0; // amount copied so far, in bytes
     uint32_t copy_location = PROCESS_ENTRY_POINT; // virtual address, travels with amount copied
@@ -115,15 +123,18 @@ int32_t sys_run(const char *process_path, const uint32_t permissions_identifier,
             return -1;
         }
 
-        // Get a new real address based on the current virtual address
-        if (!pagetable_getmap(child_proc->pagetable, copy_location, &real_addr)) {
+        // Get the frame of the current virtual address. Chunks divide the
+        // page size, so a chunk never spans two frames.
+        if (!pagetable_getframe(child_proc->pagetable, copy_location, &frame)) {
             console_printf("Unable to get physical mapping of vmem location %x\n", copy_location);
             // free the intermediary memory we used
             kfree(process_data);
             process_cleanup(child_proc);
             return -1;
         }
-        memcpy((void *)real_addr, (void *)process_data, to_be_copied); // copy the data to the current real address
+        uint8_t *page = pagetable_kmap(frame);
+        memcpy(page + copy_location % PAGE_SIZE, (void *)process_data, to_be_copied); // copy the data into the frame
+        pagetable_kunmap(page);
         amount_copied += to_be_copied; // log the amount copied
         copy_location += to_be_copied; // move the virtual address up by the amount copied
     }
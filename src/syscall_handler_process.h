@@ -11,6 +11,7 @@ See the file LICENSE for details.
 
 int32_t sys_exit(uint32_t code);
 int32_t sys_yield();
+int32_t sys_setpriority(uint32_t priority);
 int32_t sys_run(const char *process_path, const uint32_t permissions_identifier, struct process *parent);
 
 #endif
\ No newline at end of file
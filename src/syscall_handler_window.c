@@ -6,6 +6,7 @@ See the file LICENSE for details.
 #include "syscall_handler_window.h"
 #include "process.h"
 #include "string.h"
+#include "interrupt.h"
 
 #define CHECK_PROC_WINDOW() if(current->window == 0) return -1
 
@@ -64,7 +65,9 @@ int32_t sys_clear() {
 int32_t sys_get_event(struct event *e) {
     CHECK_PROC_WINDOW();
     struct list *list = &(current->window->event_queue);
+    unsigned flags = interrupt_save();
     struct event *last_event = (struct event *)list_pop_tail(list);
+    interrupt_restore(flags);
     if (last_event == 0) {
         return 2;
     }
@@ -0,0 +1,121 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "timer.h"
+#include "interrupt.h"
+
+static struct timer *heap[TIMER_MAX];
+static uint32_t heap_size = 0;
+
+// Deadlines wrap around, so compare them by their difference
+static int timer_before(struct timer *a, struct timer *b) {
+    return (int32_t)(a->deadline - b->deadline) < 0;
+}
+
+static void timer_place(struct timer *t, uint32_t i) {
+    heap[i] = t;
+    t->index = i;
+}
+
+static void timer_sift_up(uint32_t i) {
+    struct timer *t = heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!timer_before(t, heap[parent])) {
+            break;
+        }
+        timer_place(heap[parent], i);
+        i = parent;
+    }
+    timer_place(t, i);
+}
+
+static void timer_sift_down(uint32_t i) {
+    struct timer *t = heap[i];
+    while (1) {
+        uint32_t child = 2 * i + 1;
+        if (child >= heap_size) {
+            break;
+        }
+        if (child + 1 < heap_size && timer_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!timer_before(heap[child], t)) {
+            break;
+        }
+        timer_place(heap[child], i);
+        i = child;
+    }
+    timer_place(t, i);
+}
+
+static void timer_remove(struct timer *t) {
+    uint32_t i = t->index;
+    t->index = TIMER_INACTIVE;
+    heap_size--;
+    if (i == heap_size) {
+        return;
+    }
+    // Fill the hole with the last timer, which may belong above or below it
+    struct timer *last = heap[heap_size];
+    timer_place(last, i);
+    timer_sift_up(i);
+    timer_sift_down(last->index);
+}
+
+void timer_init(struct timer *t, void (*func)(void *arg), void *arg) {
+    t->deadline = 0;
+    t->func = func;
+    t->arg = arg;
+    t->index = TIMER_INACTIVE;
+}
+
+int timer_add(struct timer *t, uint32_t deadline) {
+    unsigned flags = interrupt_save();
+    if (t->index != TIMER_INACTIVE) {
+        timer_remove(t);
+    }
+    if (heap_size == TIMER_MAX) {
+        interrupt_restore(flags);
+        return 0;
+    }
+    t->deadline = deadline;
+    timer_place(t, heap_size++);
+    timer_sift_up(t->index);
+    interrupt_restore(flags);
+    return 1;
+}
+
+int timer_cancel(struct timer *t) {
+    unsigned flags = interrupt_save();
+    int pending = t->index != TIMER_INACTIVE;
+    if (pending) {
+        timer_remove(t);
+    }
+    interrupt_restore(flags);
+    return pending;
+}
+
+uint32_t timer_next(uint32_t now) {
+    unsigned flags = interrupt_save();
+    uint32_t next = 0xffffffff;
+    if (heap_size > 0) {
+        int32_t left = heap[0]->deadline - now;
+        next = left > 0 ? left : 0;
+    }
+    interrupt_restore(flags);
+    return next;
+}
+
+void timer_expire(uint32_t now) {
+    unsigned flags = interrupt_save();
+    while (heap_size > 0 && (int32_t)(heap[0]->deadline - now) <= 0) {
+        struct timer *t = heap[0];
+        timer_remove(t);
+        t->func(t->arg);
+    }
+    interrupt_restore(flags);
+}
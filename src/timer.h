@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "kerneltypes.h"
+
+// Most timers that can be pending at once
+#define TIMER_MAX 1024
+
+#define TIMER_INACTIVE 0xffffffff
+
+/*
+ * A kernel timer calls func(arg) from the clock interrupt once the tick
+ * count reaches deadline. Pending timers are kept in a min-heap ordered by
+ * deadline, so a tick only looks at the timers that expire on it.
+ */
+struct timer {
+    uint32_t deadline;      // in ticks, as returned by clock_ticks
+    void (*func)(void *arg);
+    void *arg;
+    uint32_t index;         // position in the heap, or TIMER_INACTIVE
+};
+
+/**
+ * @brief   Set up a timer that is not pending yet
+ *
+ * @param   t       The timer
+ * @param   func    Function to call when the timer expires, with interrupts
+ *                  blocked
+ * @param   arg     Argument passed to func
+ */
+void timer_init(struct timer *t, void (*func)(void *arg), void *arg);
+
+/**
+ * @brief   Make a timer expire at the given tick
+ * @details A timer that is already pending is moved to the new deadline.
+ *          A deadline that has passed already expires on the next tick.
+ *
+ * @param   t           A timer set up with timer_init
+ * @param   deadline    Tick at which to call the function of the timer
+ * @return  1 on success, 0 if TIMER_MAX timers are pending already
+ */
+int timer_add(struct timer *t, uint32_t deadline);
+
+/**
+ * @brief   Remove a pending timer
+ *
+ * @param   t   The timer
+ * @return  1 if the timer was pending, 0 if it had expired or was not added
+ */
+int timer_cancel(struct timer *t);
+
+/**
+ * @brief   Ticks until the earliest pending timer expires
+ *
+ * @param   now The current tick
+ * @return  0 if a timer is due already, 0xffffffff if none is pending
+ */
+uint32_t timer_next(uint32_t now);
+
+/**
+ * @brief   Call the functions of every timer due at the given tick
+ * @details Meant for the clock interrupt. A function may add timers again,
+ *          including its own.
+ *
+ * @param   now The current tick
+ */
+void timer_expire(uint32_t now);
+
+#endif
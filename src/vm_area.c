@@ -0,0 +1,190 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "vm_area.h"
+#include "kmalloc.h"
+
+// Ranges are compared as start + offset < length throughout, so that an area
+// ending at the very top of the address space does not overflow.
+
+static int vm_area_height(struct vm_area *a) {
+    return a ? a->height : 0;
+}
+
+static void vm_area_update_height(struct vm_area *a) {
+    int l = vm_area_height(a->left);
+    int r = vm_area_height(a->right);
+    a->height = 1 + (l > r ? l : r);
+}
+
+static struct vm_area *vm_area_rotate_right(struct vm_area *a) {
+    struct vm_area *b = a->left;
+    a->left = b->right;
+    b->right = a;
+    vm_area_update_height(a);
+    vm_area_update_height(b);
+    return b;
+}
+
+static struct vm_area *vm_area_rotate_left(struct vm_area *a) {
+    struct vm_area *b = a->right;
+    a->right = b->left;
+    b->left = a;
+    vm_area_update_height(a);
+    vm_area_update_height(b);
+    return b;
+}
+
+static struct vm_area *vm_area_balance(struct vm_area *a) {
+    vm_area_update_height(a);
+    int balance = vm_area_height(a->left) - vm_area_height(a->right);
+    if (balance > 1) {
+        if (vm_area_height(a->left->left) < vm_area_height(a->left->right)) {
+            a->left = vm_area_rotate_left(a->left);
+        }
+        return vm_area_rotate_right(a);
+    }
+    if (balance < -1) {
+        if (vm_area_height(a->right->right) < vm_area_height(a->right->left)) {
+            a->right = vm_area_rotate_right(a->right);
+        }
+        return vm_area_rotate_left(a);
+    }
+    return a;
+}
+
+static struct vm_area *vm_area_insert_at(struct vm_area *root, struct vm_area *a) {
+    if (!root) {
+        return a;
+    }
+    if (a->start < root->start) {
+        root->left = vm_area_insert_at(root->left, a);
+    } else {
+        root->right = vm_area_insert_at(root->right, a);
+    }
+    return vm_area_balance(root);
+}
+
+// Unlinks the lowest area of a subtree, storing it in *min
+static struct vm_area *vm_area_remove_min(struct vm_area *root, struct vm_area **min) {
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = vm_area_remove_min(root->left, min);
+    return vm_area_balance(root);
+}
+
+static struct vm_area *vm_area_remove_at(struct vm_area *root, struct vm_area *a) {
+    if (!root) {
+        return 0;
+    }
+    if (a->start < root->start) {
+        root->left = vm_area_remove_at(root->left, a);
+    } else if (a->start > root->start) {
+        root->right = vm_area_remove_at(root->right, a);
+    } else {
+        struct vm_area *left = root->left;
+        struct vm_area *right = root->right;
+        if (!right) {
+            return left;
+        }
+        struct vm_area *successor;
+        right = vm_area_remove_min(right, &successor);
+        successor->left = left;
+        successor->right = right;
+        return vm_area_balance(successor);
+    }
+    return vm_area_balance(root);
+}
+
+struct vm_area *vm_area_create(uint32_t start, uint32_t length, int type) {
+    struct vm_area *a = kmalloc(sizeof(*a));
+    if (!a) {
+        return 0;
+    }
+    a->left = 0;
+    a->right = 0;
+    a->height = 1;
+    a->start = start;
+    a->length = length;
+    a->type = type;
+    a->ata_unit = 0;
+    a->extent = 0;
+    a->offset = 0;
+    a->data_length = 0;
+    return a;
+}
+
+void vm_area_insert(struct vm_area **root, struct vm_area *a) {
+    a->left = 0;
+    a->right = 0;
+    a->height = 1;
+    *root = vm_area_insert_at(*root, a);
+}
+
+void vm_area_remove(struct vm_area **root, struct vm_area *a) {
+    *root = vm_area_remove_at(*root, a);
+    a->left = 0;
+    a->right = 0;
+}
+
+struct vm_area *vm_area_find(struct vm_area *root, uint32_t vaddr) {
+    while (root) {
+        if (vaddr < root->start) {
+            root = root->left;
+        } else if (vaddr - root->start < root->length) {
+            return root;
+        } else {
+            root = root->right;
+        }
+    }
+    return 0;
+}
+
+struct vm_area *vm_area_find_overlap(struct vm_area *root, uint32_t start,
+                                     uint32_t length) {
+    while (root) {
+        if (start < root->start) {
+            if (root->start - start < length) {
+                return root;
+            }
+            root = root->left;
+        } else if (start - root->start < root->length) {
+            return root;
+        } else {
+            root = root->right;
+        }
+    }
+    return 0;
+}
+
+uint32_t vm_area_find_gap(struct vm_area *root, uint32_t min, uint32_t max,
+                          uint32_t length) {
+    uint32_t candidate = min;
+    while (candidate < max && max - candidate >= length) {
+        struct vm_area *a = vm_area_find_overlap(root, candidate, length);
+        if (!a) {
+            return candidate;
+        }
+        if (a->start + a->length < candidate) {
+            // The area runs to the top of the address space
+            return 0;
+        }
+        candidate = a->start + a->length;
+    }
+    return 0;
+}
+
+struct vm_area *vm_area_first(struct vm_area *root) {
+    if (!root) {
+        return 0;
+    }
+    while (root->left) {
+        root = root->left;
+    }
+    return root;
+}
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef VM_AREA_H
+#define VM_AREA_H
+
+#include "kerneltypes.h"
+
+#define VM_AREA_ANON  0 // zero-filled memory reserved with mmap
+#define VM_AREA_FILE  1 // read-only view of a file through the page cache
+#define VM_AREA_CODE  2 // the program image
+#define VM_AREA_HEAP  3 // zero-filled memory ending at the break
+#define VM_AREA_STACK 4 // zero-filled memory growing down from the top
+#define VM_AREA_SHARED 5 // kernel page mapped read-only in every process
+
+/*
+ * A range of the user address space that a process may access. The areas of
+ * a process never overlap, and are kept in an AVL tree sorted by start
+ * address, so the page fault handler finds the area of an address in
+ * logarithmic time.
+ */
+struct vm_area {
+    struct vm_area *left;
+    struct vm_area *right;
+    int height;
+
+    uint32_t start;         // first virtual address, page aligned
+    uint32_t length;        // length in bytes, a multiple of PAGE_SIZE
+    int type;
+
+    // VM_AREA_FILE only
+    int ata_unit;
+    uint32_t extent;        // first ATAPI block of the file
+    uint32_t offset;        // offset into the file of the first page
+    uint32_t data_length;   // length of the whole file
+};
+
+/**
+ * @brief   Allocate a new area
+ * @details The area is not part of any tree until passed to vm_area_insert.
+ *
+ * @param   start   First virtual address of the area, page aligned
+ * @param   length  Length of the area in bytes, a multiple of PAGE_SIZE
+ * @param   type    One of the VM_AREA_ types
+ * @return  The new area, or 0 if it could not be allocated
+ */
+struct vm_area *vm_area_create(uint32_t start, uint32_t length, int type);
+
+/**
+ * @brief   Insert an area into a tree
+ * @details The caller must make sure the area overlaps no area of the tree.
+ *
+ * @param   root    Pointer to the root of the tree, updated on rebalancing
+ * @param   a       The area to insert
+ */
+void vm_area_insert(struct vm_area **root, struct vm_area *a);
+
+/**
+ * @brief   Remove an area from a tree
+ * @details The area itself is not freed.
+ *
+ * @param   root    Pointer to the root of the tree, updated on rebalancing
+ * @param   a       The area to remove
+ */
+void vm_area_remove(struct vm_area **root, struct vm_area *a);
+
+/**
+ * @brief   Find the area containing an address
+ *
+ * @param   root    The root of the tree
+ * @param   vaddr   The address to look up
+ * @return  The area containing vaddr, or 0 if there is none
+ */
+struct vm_area *vm_area_find(struct vm_area *root, uint32_t vaddr);
+
+/**
+ * @brief   Find an area overlapping a range
+ *
+ * @param   root    The root of the tree
+ * @param   start   First address of the range
+ * @param   length  Length of the range in bytes
+ * @return  Any area overlapping the range, or 0 if the range is free
+ */
+struct vm_area *vm_area_find_overlap(struct vm_area *root, uint32_t start,
+                                     uint32_t length);
+
+/**
+ * @brief   Find the lowest free range of a given length within bounds
+ *
+ * @param   root    The root of the tree
+ * @param   min     Lowest address the range may start at, page aligned
+ * @param   max     Address the range must end at or below
+ * @param   length  Length of the range in bytes
+ * @return  The start of the free range, or 0 if there is none
+ */
+uint32_t vm_area_find_gap(struct vm_area *root, uint32_t min, uint32_t max,
+                          uint32_t length);
+
+/**
+ * @brief   Find the area with the lowest start address
+ *
+ * @param   root    The root of the tree
+ * @return  The lowest area, or 0 if the tree is empty
+ */
+struct vm_area *vm_area_first(struct vm_area *root);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "vmalloc.h"
+#include "kmalloc.h"
+#include "memory_raw.h"
+#include "memorylayout.h"
+#include "pagetable.h"
+#include "interrupt.h"
+#include "console.h"
+#include "bitmap.h"
+
+#define VMALLOC_PAGES ((KERNEL_VMALLOC_END - KERNEL_VMALLOC_START) / PAGE_SIZE)
+
+// A buffer handed out by vmalloc
+struct vmalloc_area {
+    struct vmalloc_area *next;
+    uint32_t start;
+    uint32_t npages;        // mapped pages, not counting the guard page
+};
+
+// Pages of the region, a set bit is a free page
+static uint32_t vmalloc_free_map[BITMAP_CELLS(VMALLOC_PAGES)];
+
+// No free page in the cells below
+static uint32_t vmalloc_hint = 0;
+
+static struct vmalloc_area *vmalloc_areas = 0;
+
+void vmalloc_init() {
+    uint32_t i;
+    for (i = 0; i < VMALLOC_PAGES; i++) {
+        bitmap_set(vmalloc_free_map, i);
+    }
+    vmalloc_hint = 0;
+    vmalloc_areas = 0;
+}
+
+int vmalloc_owns(const void *addr) {
+    return (uint32_t)addr >= KERNEL_VMALLOC_START &&
+           (uint32_t)addr < KERNEL_VMALLOC_END;
+}
+
+// Find and claim the first run of npages free pages, returning the index of
+// its first page, or -1
+static int32_t vmalloc_claim(uint32_t npages) {
+    uint32_t i = vmalloc_hint * BITMAP_CELL_BITS;
+    uint32_t run = 0;
+
+    while (i < VMALLOC_PAGES) {
+        if (run == 0 && i % BITMAP_CELL_BITS == 0 &&
+            vmalloc_free_map[i / BITMAP_CELL_BITS] == 0) {
+            // The whole cell is taken
+            i += BITMAP_CELL_BITS;
+            continue;
+        }
+        if (!bitmap_test(vmalloc_free_map, i)) {
+            run = 0;
+            i++;
+            continue;
+        }
+        run++;
+        i++;
+        if (run == npages) {
+            uint32_t first = i - npages;
+            uint32_t j;
+            for (j = first; j < i; j++) {
+                bitmap_clear(vmalloc_free_map, j);
+            }
+            // Keep the hint past the cells this claim filled up
+            while (vmalloc_hint < BITMAP_CELLS(VMALLOC_PAGES) &&
+                   vmalloc_free_map[vmalloc_hint] == 0) {
+                vmalloc_hint++;
+            }
+            return first;
+        }
+    }
+    return -1;
+}
+
+static void vmalloc_release(uint32_t first, uint32_t npages) {
+    uint32_t j;
+    for (j = first; j < first + npages; j++) {
+        bitmap_set(vmalloc_free_map, j);
+    }
+    if (first / BITMAP_CELL_BITS < vmalloc_hint) {
+        vmalloc_hint = first / BITMAP_CELL_BITS;
+    }
+}
+
+// Unmap the pages of a buffer and give their frames back
+static void vmalloc_unmap(uint32_t start, uint32_t npages) {
+    struct pagetable *k = pagetable_kernel();
+    uint32_t i, frame;
+    for (i = 0; i < npages; i++) {
+        uint32_t vaddr = start + i * PAGE_SIZE;
+        if (pagetable_getframe(k, vaddr, &frame)) {
+            pagetable_unmap(k, vaddr);
+            memory_free_frame(frame);
+        }
+    }
+}
+
+void *vmalloc(uint32_t size) {
+    if (size == 0 || size > KERNEL_VMALLOC_END - KERNEL_VMALLOC_START) {
+        return 0;
+    }
+
+    uint32_t npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    struct vmalloc_area *a = kmalloc(sizeof(*a));
+    if (!a) {
+        return 0;
+    }
+
+    // The extra page stays unmapped as a guard
+    unsigned flags = interrupt_save();
+    int32_t first = vmalloc_claim(npages + 1);
+    interrupt_restore(flags);
+    if (first < 0) {
+        console_printf("vmalloc: no room for %d bytes\n", size);
+        kfree(a);
+        return 0;
+    }
+
+    a->start = KERNEL_VMALLOC_START + first * PAGE_SIZE;
+    a->npages = npages;
+
+    // Any frame will do, those above the direct map included
+    struct pagetable *k = pagetable_kernel();
+    uint32_t i;
+    for (i = 0; i < npages; i++) {
+        uint32_t frame = memory_alloc_frame(0);
+        if (frame) {
+            memory_frame_page(frame)->flags = PAGE_STATE_KERNEL;
+        }
+        if (!frame || !pagetable_map_frame(k, a->start + i * PAGE_SIZE, frame,
+                                           PAGE_FLAG_KERNEL |
+                                           PAGE_FLAG_READWRITE)) {
+            if (frame) {
+                memory_free_frame(frame);
+            }
+            vmalloc_unmap(a->start, i);
+            flags = interrupt_save();
+            vmalloc_release(first, npages + 1);
+            interrupt_restore(flags);
+            kfree(a);
+            return 0;
+        }
+    }
+
+    flags = interrupt_save();
+    a->next = vmalloc_areas;
+    vmalloc_areas = a;
+    interrupt_restore(flags);
+
+    return (void *)a->start;
+}
+
+void vfree(void *addr) {
+    struct vmalloc_area **pa;
+    struct vmalloc_area *a = 0;
+
+    if (!addr) {
+        return;
+    }
+
+    unsigned flags = interrupt_save();
+    for (pa = &vmalloc_areas; *pa; pa = &(*pa)->next) {
+        if ((*pa)->start == (uint32_t)addr) {
+            a = *pa;
+            *pa = a->next;
+            break;
+        }
+    }
+    interrupt_restore(flags);
+
+    if (!a) {
+        console_printf("vfree(%x) failed as it was not vmalloc'd\n", addr);
+        return;
+    }
+
+    vmalloc_unmap(a->start, a->npages);
+
+    flags = interrupt_save();
+    vmalloc_release((a->start - KERNEL_VMALLOC_START) / PAGE_SIZE,
+                    a->npages + 1);
+    interrupt_restore(flags);
+    kfree(a);
+}
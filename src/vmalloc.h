@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include "kerneltypes.h"
+
+/**
+ * @brief   Set up the vmalloc region
+ * @details Must be called after pagetable_kernel_init, which creates the
+ *          page tables of the region.
+ */
+void vmalloc_init();
+
+/**
+ * @brief   Allocate a large kernel buffer
+ * @details Reserves whole pages between KERNEL_VMALLOC_START and
+ *          KERNEL_VMALLOC_END, and backs each of them with its own frame,
+ *          so the buffer is contiguous in kernel space only. An unmapped
+ *          page is left after every buffer to catch overruns. The buffer is
+ *          mapped in every process, and is never paged out.
+ *
+ * @param   size    Number of bytes to allocate
+ * @return  A page aligned pointer to the buffer, which needs to be vfree()'d,
+ *          or 0 if the region is full
+ */
+void *vmalloc(uint32_t size);
+
+/**
+ * @brief   Free a buffer returned by vmalloc
+ *
+ * @param   addr    The pointer returned by vmalloc
+ */
+void vfree(void *addr);
+
+/**
+ * @brief   Test whether an address was handed out by vmalloc
+ *
+ * @param   addr    Any kernel address
+ * @return  1 if addr lies in the vmalloc region; 0 otherwise
+ */
+int vmalloc_owns(const void *addr);
+
+#endif
@@ -7,6 +7,7 @@ See the file LICENSE for details.
 #include "window_manager.h"
 #include "kmalloc.h"
 #include "window.h"
+#include "interrupt.h"
 
 struct window *active_window = 0;
 
@@ -15,8 +16,11 @@ static void send_event(struct event *e) {
 		return;
 	}
 
+	// Events come from the worker thread, so keep get_event out
+	unsigned flags = interrupt_save();
 	struct list *l = &(active_window->event_queue);
 	list_push_head(l, (struct list_node *)e);
+	interrupt_restore(flags);
 }
 
 void send_event_mouse_click() {
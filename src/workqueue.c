@@ -0,0 +1,44 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#include "workqueue.h"
+#include "console.h"
+#include "interrupt.h"
+#include "process.h"
+
+static struct list work_list = LIST_INIT;
+static struct list worker_queue = LIST_INIT;
+
+static void workqueue_worker(void *arg) {
+    while (1) {
+        interrupt_block();
+        struct work *w = (struct work *)list_pop_head(&work_list);
+        if (!w) {
+            process_wait(&worker_queue);
+            continue;
+        }
+        // Clear pending first, so that the item can be queued again while
+        // it runs
+        w->pending = 0;
+        interrupt_unblock();
+        w->func(w->arg);
+    }
+}
+
+void workqueue_init() {
+    struct process *p = process_create_kernel(workqueue_worker, 0);
+    console_printf("workqueue: worker is process %d\n", p->pid);
+}
+
+void work_schedule(struct work *w) {
+    unsigned flags = interrupt_save();
+    if (!w->pending) {
+        w->pending = 1;
+        list_push_tail(&work_list, &w->node);
+        process_wakeup(&worker_queue);
+    }
+    interrupt_restore(flags);
+}
@@ -0,0 +1,45 @@
+/*
+Copyright (C) 2016 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file LICENSE for details.
+*/
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "list.h"
+
+/*
+Deferred work for interrupt handlers. A handler does the part that must
+happen right away (reading the device), then schedules a work item, whose
+function runs soon after in a kernel thread with interrupts on. Heavy
+work, such as drawing or allocating, belongs there.
+*/
+
+struct work {
+    struct list_node node;
+    void (*func)(void *arg);
+    void *arg;
+    int pending;        // queued and not started yet
+};
+
+#define WORK_INIT(func, arg) {{0, 0, 0, 0}, func, arg, 0}
+
+/**
+ * @brief   Start the worker thread
+ * @details Work scheduled before this runs as soon as the thread starts.
+ *          Must run after process_init.
+ */
+void workqueue_init();
+
+/**
+ * @brief   Queue a work item
+ * @details Safe to call from interrupt handlers. Scheduling an item that is
+ *          already pending does nothing, so bursts of interrupts collapse
+ *          into one run of the function.
+ *
+ * @param   w   The work item
+ */
+void work_schedule(struct work *w);
+
+#endif
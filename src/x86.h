@@ -56,10 +56,17 @@ struct x86_eflags {
     int32_t ebp;
 };
 
+// The registers switch_to saves, in the order it pushes them
+struct x86_switch_frame {
+    int32_t edi;
+    int32_t esi;
+    int32_t ebx;
+    int32_t ebp;
+    int32_t eip;    // where switch_to returns
+};
+
 struct x86_stack {
-    struct x86_regs regs2;
-    int32_t old_ebp;
-    int32_t old_addr;
+    struct x86_switch_frame frame;
     struct x86_regs regs1;
     int32_t ds;
     int32_t intr_num;